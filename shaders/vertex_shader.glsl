@@ -12,10 +12,22 @@ out vec3 v_normal;
 uniform mat4 u_Proj;
 uniform mat4 u_Model;
 uniform mat4 u_View;
+// packed vertices: positions on the bounding box grid and octahedral
+// normals in normal.xy, identity and false for float vertices
+uniform mat4 u_Dequantize;
+uniform bool u_OctahedralNormals;
+
+vec3 octahedral_decode(vec2 f){
+    vec3 n = vec3(f, 1.0f - abs(f.x) - abs(f.y));
+    float t = max(-n.z, 0.0f);
+    n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0f)));
+    return normalize(n);
+}
 
 void main(){
-    v_pos = position;
+    vec3 pos = (u_Dequantize * vec4(position, 1.0f)).xyz;
+    v_pos = pos;
     v_color = color;
-    v_normal = normal;
-    gl_Position = u_Proj * u_View * u_Model * vec4(position, 1.0f);
+    v_normal = u_OctahedralNormals ? octahedral_decode(normal.xy) : normal;
+    gl_Position = u_Proj * u_View * u_Model * vec4(pos, 1.0f);
 }
\ No newline at end of file
@@ -12,10 +12,21 @@
 #include <glm/ext.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "geometry/overdraw.hpp"
+#include "geometry/simplify.hpp"
+#include "geometry/vertex_cache.hpp"
+#include "io/compressed_format.hpp"
+#include "io/mesher_format.hpp"
 #include "raytracer/bvh.hpp"
+#include "raytracer/sdf.hpp"
+#include "raytracer/thickness.hpp"
 #include "renderer/camera.hpp"
+#include "slicer/slicer.hpp"
+#include "streaming/chunk_builder.hpp"
+#include "streaming/chunked_mesh.hpp"
 #include "renderer/shader.hpp"
 #include "context.hpp"
+#include "loader.hpp"
 #include "mesh.hpp"
 #include "../include/glad.h"
 
@@ -29,10 +40,17 @@ Context ctx;
 Shader shader;
 Mesh mesh, mesh_box;
 std::vector<Mesh> triangles;
-// prune duplicates from selected triangles 
-std::unordered_set<uint32_t> tris_idxs; 
+// prune duplicates from selected triangles, chunk id in the upper half
+// for chunked meshes
+std::unordered_set<uint64_t> tris_idxs; 
 
 BVH bvh;
+// drag and dropped files load in the background
+MeshLoader loader;
+// out-of-core mesh (.mshc), drawn instead of mesh while it is open
+ChunkedMesh chunked;
+// bytes of chunks kept in memory, --budget in MB
+uint64_t streaming_budget = 1ull << 30;
 Camera camera(glm::vec3(1.0f, 2.0f, 2.0f), // pos of camera
               glm::vec3(0.0f, 0.0f, 0.0f)  // where camera is looking
 );
@@ -70,6 +88,42 @@ void initialize_program() {
     shader = Shader(vertex_shader_path.c_str(), fragment_shader_path.c_str());
 }
 
+// paints the mesh by wall thickness (red = thin)
+static void show_wall_thickness() {
+    using namespace std::chrono;
+    // needs the whole mesh in one BVH, and a mesh at all
+    if (chunked.is_open() || bvh.mesh == nullptr || mesh.triangles.empty())
+        return;
+    steady_clock::time_point begin = steady_clock::now();
+    std::vector<float> thickness = compute_wall_thickness(bvh);
+    color_by_thickness(mesh, thickness, ThicknessOptions());
+    mesh.update_vertices();
+    steady_clock::time_point end = steady_clock::now();
+
+    float min = INFINITY;
+    for (float t : thickness)
+        min = glm::min(min, t);
+    std::cout << "Wall thickness for " << thickness.size() << " triangles "
+              << duration_cast<milliseconds>(end - begin).count() << "[ms]"
+              << ", thinnest " << min << std::endl;
+}
+
+// highlights the triangle under the mouse in a chunked mesh
+static void pick_chunked(glm::vec2 mouse) {
+    glm::mat4 view_model = VIEW * chunked.get_model_matrix();
+    Ray ray = mouse_to_object_space(mouse, ctx.get_viewport(), view_model,
+                                    PROJ);
+    auto hit = chunked.pick(ray);
+    if (!hit.has_value())
+        return;
+    uint64_t key = ((uint64_t)hit->chunk << 32) | hit->tri_idx;
+    if (tris_idxs.find(key) == tris_idxs.end()) {
+        triangles.push_back(
+            chunked.chunk_mesh(hit->chunk).highlight_triangle(hit->tri_idx));
+        tris_idxs.insert(key);
+    }
+}
+
 void handle_input() {
     using namespace std::chrono;
     SDL_Event event;
@@ -81,14 +135,35 @@ void handle_input() {
             return;
         } else if (event.type == SDL_DROPFILE) {
             std::cout << event.drop.file << std::endl;
-            mesh = Mesh(std::string(event.drop.file));
-            bvh = BVH(mesh);
+            std::string path(event.drop.file);
+            if (fs::path(path).extension() == ".mshc") {
+                // the index is small, the chunks stream in from update()
+                loader.cancel();
+                if (chunked.open(path)) {
+                    mesh = Mesh();
+                    bvh = BVH();
+                    triangles.clear();
+                    tris_idxs.clear();
+                }
+            } else {
+                loader.start(path);
+            }
+            SDL_free(event.drop.file);
         } else if (event.type == SDL_KEYDOWN) {
+            if(event.key.keysym.sym == SDLK_ESCAPE && loader.is_busy()){
+                loader.cancel();
+                SDL_SetWindowTitle(ctx.window, "mesher");
+                continue;
+            }
             if(event.key.keysym.sym == SDLK_q){
                 triangles.clear();
                 tris_idxs.clear();
                 continue;
             }
+            if(event.key.keysym.sym == SDLK_t){
+                show_wall_thickness();
+                continue;
+            }
             camera.handle_key_action(event.key.keysym.sym, 0.05f);
         } else if (event.type == SDL_MOUSEBUTTONUP ||
                    event.type == SDL_MOUSEBUTTONDOWN) {
@@ -104,6 +179,10 @@ void handle_input() {
                 camera.handle_mouse_action(xpos, ypos);
                 continue;
             }
+            if (chunked.is_open()) {
+                pick_chunked(glm::vec2(event.motion.x, event.motion.y));
+                continue;
+            }
             // steady_clock::time_point begin = steady_clock::now();
             auto triangle_opt =
                 check_intersection(glm::vec2(event.motion.x, event.motion.y),
@@ -123,6 +202,37 @@ void handle_input() {
     }
 }
 
+// swaps in a finished background load and reports progress in the title
+static void update_loader() {
+    static LoadStage last_stage = LoadStage::Done;
+    LoadStage stage = loader.stage();
+    if (loader.poll(mesh, bvh)) {
+        chunked.close();
+        triangles.clear();
+        tris_idxs.clear();
+        mesh_box = mesh.construct_bounding_box();
+        std::cout << "Loaded " << mesh.triangles.size() << " triangles, "
+                  << mesh.lods.size() << " levels of detail, "
+                  << mesh.clusters.size() << " clusters" << std::endl;
+    }
+    if (stage == last_stage)
+        return;
+    last_stage = stage;
+    std::string title = "mesher";
+    if (loader.is_busy()) {
+        // stages before BuildingBVH count up from Parsing
+        uint32_t step = (uint32_t)stage;
+        title += " - loading " +
+                 fs::path(loader.get_filepath()).filename().string() + " (" +
+                 std::to_string(step) + "/" +
+                 std::to_string((uint32_t)LoadStage::BuildingBVH) + " " +
+                 stage_name(stage) + ")";
+    } else if (stage == LoadStage::Failed) {
+        title += " - failed to load " + loader.get_filepath();
+    }
+    SDL_SetWindowTitle(ctx.window, title.c_str());
+}
+
 void pre_draw() {
     ctx.update_window();
 
@@ -143,7 +253,8 @@ void pre_draw() {
     glPolygonMode(GL_BACK, GL_LINE);
 
     shader.use();
-    MODEL = mesh.get_model_matrix();
+    MODEL = chunked.is_open() ? chunked.get_model_matrix()
+                              : mesh.get_model_matrix();
     PROJ = glm::perspective(glm::radians(FOV),
                             (float)ctx.width / (float)ctx.height, NEAR_CLIP,
                             FAR_CLIP);
@@ -168,8 +279,23 @@ void main_loop() {
     while (!ctx.is_quit) {
         start = SDL_GetPerformanceCounter();
         handle_input();
+        update_loader();
         pre_draw();
-        mesh.draw(shader);
+        if (chunked.is_open()) {
+            glm::vec3 eye = glm::vec3(glm::inverse(MODEL) *
+                                      glm::vec4(camera.get_pos(), 1.0f));
+            chunked.update(eye, streaming_budget);
+            chunked.draw(shader);
+        } else {
+            if (!mesh.clusters.empty()) {
+                mesh.cull_clusters(VIEW * MODEL, PROJ, (float)ctx.height);
+            } else {
+                mesh.select_lod(VIEW * MODEL, PROJ, (float)ctx.height);
+                // lines of back faces show through the wireframe
+                mesh.cull_meshlets(VIEW * MODEL, PROJ, false);
+            }
+            mesh.draw(shader);
+        }
         for(auto& tri: triangles)
             tri.draw(shader);
         // mesh_box.draw(shader);
@@ -186,20 +312,282 @@ void main_loop() {
     }
 }
 
+// mesher <file> --sdf <out> [resolution] [narrow band in voxels]
+//                          [parity|winding], no window needed
+static int export_sdf(int argc, char *argv[]) {
+    using namespace std::chrono;
+    if (!load_mesh(argv[1], mesh, bvh))
+        return EXIT_FAILURE;
+    SDFOptions opts;
+    if (argc > 4)
+        opts.resolution = std::stoi(argv[4]);
+    if (argc > 5)
+        opts.narrow_band = std::stof(argv[5]);
+    if (argc > 6 && std::string(argv[6]) == "winding")
+        opts.sign = SDFSign::Winding;
+    steady_clock::time_point begin = steady_clock::now();
+    SDFGrid grid = compute_sdf(bvh, opts);
+    steady_clock::time_point end = steady_clock::now();
+    std::cout << "SDF " << grid.dims.x << "x" << grid.dims.y << "x"
+              << grid.dims.z << " "
+              << duration_cast<milliseconds>(end - begin).count() << "[ms]"
+              << std::endl;
+    return grid.write(argv[3]) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// mesher <file> --slice <out.svg|out.slices> [layer height], no window
+// needed
+static int export_slices(int argc, char *argv[]) {
+    using namespace std::chrono;
+    if (!load_mesh(argv[1], mesh, bvh))
+        return EXIT_FAILURE;
+    float layer_height = argc > 4 ? std::stof(argv[4]) : 0.2f;
+    steady_clock::time_point begin = steady_clock::now();
+    Slices slices = slice_mesh(mesh, layer_height);
+    steady_clock::time_point end = steady_clock::now();
+    std::cout << "Sliced " << slices.layers.size() << " layers "
+              << duration_cast<milliseconds>(end - begin).count() << "[ms]"
+              << std::endl;
+    std::string out = argv[3];
+    bool svg = fs::path(out).extension() == ".svg";
+    bool ok = svg ? slices.write_svg(out) : slices.write(out);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// average time of one draw of m, uploaded first
+static float time_draws(Mesh &m, uint32_t rounds = 50) {
+    m.upload();
+    pre_draw();
+    m.draw(shader);
+    glFinish();
+    uint64_t start = SDL_GetPerformanceCounter();
+    for (uint32_t i = 0; i < rounds; i++)
+        m.draw(shader);
+    glFinish();
+    uint64_t end = SDL_GetPerformanceCounter();
+    return 1000.0f * (end - start) / (float)SDL_GetPerformanceFrequency() /
+           rounds;
+}
+
+// mesher <file> --acmr, vertex cache misses and draw time of the file
+// order against the reordered one
+static int report_vertex_cache(char *argv[]) {
+    using namespace std::chrono;
+    Mesh raw;
+    raw.reorder = false;
+    raw.with_lods = false;
+    raw.with_meshlets = false;
+    if (!raw.load(argv[1]))
+        return EXIT_FAILURE;
+    VertexCacheStats before = analyze_vertex_cache(raw);
+    float before_ms = time_draws(raw);
+    steady_clock::time_point begin = steady_clock::now();
+    optimize_vertex_cache(raw);
+    optimize_vertex_fetch(raw);
+    steady_clock::time_point end = steady_clock::now();
+    VertexCacheStats after = analyze_vertex_cache(raw);
+    float after_ms = time_draws(raw);
+    std::cout << "ACMR " << before.acmr << " -> " << after.acmr << ", ATVR "
+              << before.atvr << " -> " << after.atvr << ", draw "
+              << before_ms << " -> " << after_ms << "[ms], reordered in "
+              << duration_cast<milliseconds>(end - begin).count() << "[ms]"
+              << std::endl;
+    return EXIT_SUCCESS;
+}
+
+// fragments that pass the depth test, i.e. get shaded, summed over six
+// views around m drawn filled
+static uint64_t count_shaded_pixels(Mesh &m) {
+    m.upload();
+    pre_draw();
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    const glm::vec4 views[] = {
+        {0.0f, 1.0f, 0.0f, 0.0f},   {0.0f, 1.0f, 0.0f, 90.0f},
+        {0.0f, 1.0f, 0.0f, 180.0f}, {0.0f, 1.0f, 0.0f, 270.0f},
+        {1.0f, 0.0f, 0.0f, 90.0f},  {1.0f, 0.0f, 0.0f, -90.0f},
+    };
+    GLuint query;
+    glGenQueries(1, &query);
+    uint64_t total = 0;
+    for (const glm::vec4 &view : views) {
+        glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+        glm::mat4 model = glm::rotate(glm::mat4(1.0f), glm::radians(view.w),
+                                      glm::vec3(view)) *
+                          MODEL;
+        shader.set_uniform("u_Model", model);
+        glBeginQuery(GL_SAMPLES_PASSED, query);
+        m.draw(shader);
+        glEndQuery(GL_SAMPLES_PASSED);
+        GLuint64 samples = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &samples);
+        total += samples;
+    }
+    glDeleteQueries(1, &query);
+    return total;
+}
+
+// mesher <file> --overdraw, pixels shaded per frame of the cache order
+// against the overdraw order
+static int report_overdraw(char *argv[]) {
+    using namespace std::chrono;
+    Mesh raw;
+    raw.reorder = false;
+    raw.with_lods = false;
+    raw.with_meshlets = false;
+    if (!raw.load(argv[1]))
+        return EXIT_FAILURE;
+    optimize_vertex_cache(raw);
+    float acmr_before = analyze_vertex_cache(raw).acmr;
+    uint64_t before = count_shaded_pixels(raw);
+    steady_clock::time_point begin = steady_clock::now();
+    optimize_overdraw(raw);
+    steady_clock::time_point end = steady_clock::now();
+    float acmr_after = analyze_vertex_cache(raw).acmr;
+    uint64_t after = count_shaded_pixels(raw);
+    std::cout << "Shaded pixels per frame " << before / 6 << " -> "
+              << after / 6 << ", ACMR " << acmr_before << " -> "
+              << acmr_after << ", reordered in "
+              << duration_cast<milliseconds>(end - begin).count() << "[ms]"
+              << std::endl;
+    return EXIT_SUCCESS;
+}
+
+// mesher --convert <in> <out.mesher|out.meshz> [position bits], no window
+// needed
+static int convert(int argc, char *argv[]) {
+    using namespace std::chrono;
+    std::string in = argv[2], out = argv[3];
+    steady_clock::time_point begin = steady_clock::now();
+    if (!load_mesh(in, mesh, bvh))
+        return EXIT_FAILURE;
+    bool ok;
+    if (fs::path(out).extension() == ".meshz")
+        ok = write_meshz(out, mesh,
+                         argc > 4 && argv[4][0] != '-' ? std::stoi(argv[4])
+                                                       : 16);
+    else
+        ok = write_mesher(out, mesh, bvh);
+    if (!ok)
+        return EXIT_FAILURE;
+    steady_clock::time_point end = steady_clock::now();
+    std::cout << "Converted " << mesh.triangles.size() << " triangles "
+              << duration_cast<milliseconds>(end - begin).count() << "[ms]"
+              << std::endl;
+    return EXIT_SUCCESS;
+}
+
+// mesher --simplify <in> <out.mesher|out.meshz> <triangles> [max error], no
+// window needed
+static int simplify(int argc, char *argv[]) {
+    using namespace std::chrono;
+    std::string in = argv[2], out = argv[3];
+    SimplifyOptions opts;
+    opts.target_triangles = std::stoull(argv[4]);
+    if (argc > 5 && argv[5][0] != '-')
+        opts.max_error = std::stof(argv[5]);
+    if (!load_mesh(in, mesh, bvh))
+        return EXIT_FAILURE;
+    uint64_t before = mesh.triangles.size();
+    steady_clock::time_point begin = steady_clock::now();
+    float error = simplify_mesh(mesh, opts);
+    steady_clock::time_point end = steady_clock::now();
+    bvh = BVH(mesh);
+    bool ok;
+    if (fs::path(out).extension() == ".meshz")
+        ok = write_meshz(out, mesh, 16);
+    else
+        ok = write_mesher(out, mesh, bvh);
+    if (!ok)
+        return EXIT_FAILURE;
+    std::cout << "Simplified " << before << " -> " << mesh.triangles.size()
+              << " triangles, error " << error << " of the bounding box, "
+              << duration_cast<milliseconds>(end - begin).count() << "[ms]"
+              << std::endl;
+    return EXIT_SUCCESS;
+}
+
+// mesher --chunk <in> <out.mshc> [triangles per chunk], no window needed
+static int chunk(int argc, char *argv[]) {
+    using namespace std::chrono;
+    ChunkOptions opts;
+    if (argc > 4)
+        opts.triangles_per_chunk = std::stoull(argv[4]);
+    steady_clock::time_point begin = steady_clock::now();
+    ChunkIndex index;
+    if (!build_chunks(argv[2], argv[3], opts) || !index.read(argv[3]))
+        return EXIT_FAILURE;
+    steady_clock::time_point end = steady_clock::now();
+    uint64_t count = 0;
+    for (const ChunkRecord &record : index.chunks)
+        count += record.triangle_count;
+    std::cout << "Split " << count << " triangles into "
+              << index.chunks.size() << " chunks "
+              << duration_cast<milliseconds>(end - begin).count() << "[ms]"
+              << std::endl;
+    return EXIT_SUCCESS;
+}
+
 int main(int argc, char *argv[]) {
     using namespace std::chrono;
+    for (int i = 1; i < argc; i++) {
+        // the cluster hierarchy in place of the level of detail chain, also
+        // stored by --convert and --simplify
+        if (std::string(argv[i]) == "--cluster-lod") {
+            mesh.with_lods = false;
+            mesh.with_cluster_lod = true;
+            loader.with_cluster_lod = true;
+        }
+        // merges vertices closer than this, welding cracked scans shut
+        if (std::string(argv[i]) == "--weld" && i + 1 < argc) {
+            mesh.weld_epsilon = std::stof(argv[i + 1]);
+            loader.weld_epsilon = mesh.weld_epsilon;
+        }
+    }
+    if (argc > 3 && std::string(argv[1]) == "--convert")
+        return convert(argc, argv);
+    if (argc > 3 && std::string(argv[1]) == "--chunk")
+        return chunk(argc, argv);
+    if (argc > 4 && std::string(argv[1]) == "--simplify")
+        return simplify(argc, argv);
+    if (argc > 3 && std::string(argv[2]) == "--sdf")
+        return export_sdf(argc, argv);
+    if (argc > 3 && std::string(argv[2]) == "--slice")
+        return export_slices(argc, argv);
     initialize_program();
+    for (int i = 1; i < argc; i++) {
+        // 12 byte vertices on the GPU instead of 40, for big scans
+        if (std::string(argv[i]) == "--compact") {
+            mesh.vertex_format = VertexFormat::Packed;
+            chunked.vertex_format = VertexFormat::Packed;
+        }
+        if (std::string(argv[i]) == "--budget" && i + 1 < argc)
+            streaming_budget = std::stoull(argv[i + 1]) << 20;
+    }
+    // chunks are read as the camera moves
+    if (argc > 1 && fs::path(argv[1]).extension() == ".mshc") {
+        if (!chunked.open(argv[1]))
+            return EXIT_FAILURE;
+        std::cout << "Opened " << chunked.get_index().chunks.size()
+                  << " chunks" << std::endl;
+        main_loop();
+        return 0;
+    }
     // read files from command line
-    if (argc > 1) {
-        mesh = Mesh(std::string(argv[1]));
-        mesh_box = mesh.construct_bounding_box();
+    if (argc > 1 && std::string(argv[1]).rfind("--", 0) != 0) {
         steady_clock::time_point begin = steady_clock::now();
-        bvh = BVH(mesh);
+        if (load_mesh(argv[1], mesh, bvh))
+            mesh.upload();
+        mesh_box = mesh.construct_bounding_box();
         steady_clock::time_point end = steady_clock::now();
-        std::cout << "BVH Construction for " << mesh.triangles.size() << " triangles " 
+        std::cout << "Loaded " << mesh.triangles.size() << " triangles in "
+                      << mesh.parts.size() << " parts "
                       << duration_cast<microseconds>(end - begin).count()
                       << "[us]" << std::endl;
         std::cout << mesh.triangles.size() << std::endl;
+        if (argc > 2 && std::string(argv[2]) == "--acmr")
+            return report_vertex_cache(argv);
+        if (argc > 2 && std::string(argv[2]) == "--overdraw")
+            return report_overdraw(argv);
     }
     main_loop();
     return 0;
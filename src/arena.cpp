@@ -0,0 +1,60 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#include "arena.hpp"
+
+void Arena::new_block(size_t bytes) {
+    size_t size = std::max(block_size, bytes + sizeof(Block));
+    Block *block = (Block *)std::malloc(size);
+    if (!block)
+        throw std::bad_alloc();
+    block->prev = head;
+    head = block;
+    cursor = (char *)block + sizeof(Block);
+    end = (char *)block + size;
+}
+
+void Arena::reserve(size_t bytes) {
+    if ((size_t)(end - cursor) < bytes)
+        new_block(bytes + alignof(std::max_align_t));
+}
+
+void *Arena::do_allocate(size_t bytes, size_t alignment) {
+    uintptr_t p = ((uintptr_t)cursor + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    if (!cursor || p + bytes > (uintptr_t)end) {
+        new_block(bytes + alignment);
+        p = ((uintptr_t)cursor + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    }
+    cursor = (char *)(p + bytes);
+    used_bytes += bytes;
+    return (void *)p;
+}
+
+void Arena::release() {
+    while (head) {
+        Block *prev = head->prev;
+        std::free(head);
+        head = prev;
+    }
+    cursor = end = nullptr;
+    used_bytes = 0;
+}
+
+void ScratchArenas::ensure(size_t count) {
+    while (arenas.size() < count)
+        arenas.push_back(std::make_unique<Arena>());
+}
+
+void ScratchArenas::release() {
+    for (auto &arena : arenas)
+        arena->release();
+}
+
+size_t ScratchArenas::used() const {
+    size_t total = 0;
+    for (const auto &arena : arenas)
+        total += arena->used();
+    return total;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+/*
+    Monotonic arena: allocations bump a pointer through big blocks and are
+    never freed one by one, release() hands all blocks back at once. Import
+    scratch (per range parse results, index tables) lives here, so growing
+    it costs no allocator bookkeeping and nothing is left fragmented on the
+    heap once the import is done. Blocks come straight from malloc, which
+    maps big ones lazily: reserving generously only costs address space
+    until the pages are written.
+
+    Not thread-safe, give every thread (or every range) its own arena.
+*/
+class Arena : public std::pmr::memory_resource {
+  public:
+    explicit Arena(size_t block_size = 1 << 20) : block_size(block_size) {}
+    ~Arena() override { release(); }
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    // the next `bytes` are served from one block
+    void reserve(size_t bytes);
+    // frees every block, everything allocated from the arena is gone
+    void release();
+    // bytes handed out since the last release
+    size_t used() const { return used_bytes; }
+
+  private:
+    struct Block {
+        Block *prev;
+    };
+    Block *head = nullptr;
+    char *cursor = nullptr;
+    char *end = nullptr;
+    size_t block_size;
+    size_t used_bytes = 0;
+
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void *, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource &other) const
+        noexcept override {
+        return this == &other;
+    }
+    void new_block(size_t bytes);
+};
+
+// a vector whose storage comes from an Arena
+template <typename T> using ScratchVector = std::pmr::vector<T>;
+
+/*
+    The scratch of one import: a growing set of arenas, one per parse range
+    or worker so threads never share one. Stages release() it when they are
+    done so the next stage starts from an empty heap.
+*/
+class ScratchArenas {
+  public:
+    // at least `count` arenas, existing ones keep their memory
+    void ensure(size_t count);
+    Arena &operator[](size_t i) { return *arenas[i]; }
+    size_t size() const { return arenas.size(); }
+    void release();
+    size_t used() const;
+
+  private:
+    std::vector<std::unique_ptr<Arena>> arenas;
+};
@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <cmath>
+
+#include "cluster_lod.hpp"
+#include "meshlets.hpp"
+#include "simplify.hpp"
+
+namespace {
+
+// a level that keeps more of the triangles than this ends the hierarchy
+constexpr float MIN_LEVEL_REDUCTION = 0.85f;
+
+const GLuint *cluster_indices(const Mesh &mesh, const Cluster &cluster) {
+    if (cluster.first_index < mesh.faces.size())
+        return &mesh.faces[cluster.first_index];
+    return &mesh.cluster_faces[cluster.first_index - mesh.faces.size()];
+}
+
+// greedy grouping: every ungrouped cluster, in order, starts a group and
+// pulls in the ungrouped neighbours sharing the most vertices with it
+std::vector<std::vector<uint32_t>>
+group_clusters(const Mesh &mesh, const std::vector<uint32_t> &level) {
+    const uint32_t count = level.size();
+    std::vector<std::pair<GLuint, uint32_t>> uses;
+    for (uint32_t i = 0; i < count; i++) {
+        const Cluster &cluster = mesh.clusters[level[i]];
+        const GLuint *indices = cluster_indices(mesh, cluster);
+        for (uint32_t k = 0; k < cluster.index_count; k++)
+            uses.emplace_back(indices[k], i);
+    }
+    std::sort(uses.begin(), uses.end());
+    uses.erase(std::unique(uses.begin(), uses.end()), uses.end());
+
+    // one entry per shared vertex and pair of clusters
+    std::vector<uint64_t> links;
+    for (uint64_t i = 0; i < uses.size();) {
+        uint64_t j = i;
+        while (j < uses.size() && uses[j].first == uses[i].first)
+            j++;
+        for (uint64_t a = i; a < j; a++)
+            for (uint64_t b = a + 1; b < j; b++) {
+                uint64_t x = uses[a].second, y = uses[b].second;
+                links.push_back(x << 32 | y);
+                links.push_back(y << 32 | x);
+            }
+        i = j;
+    }
+    std::sort(links.begin(), links.end());
+    std::vector<uint32_t> offsets(count + 1, 0), neighbours, weights;
+    for (uint64_t i = 0; i < links.size();) {
+        uint64_t j = i;
+        while (j < links.size() && links[j] == links[i])
+            j++;
+        offsets[(links[i] >> 32) + 1]++;
+        neighbours.push_back((uint32_t)links[i]);
+        weights.push_back(j - i);
+        i = j;
+    }
+    for (uint32_t i = 0; i < count; i++)
+        offsets[i + 1] += offsets[i];
+
+    std::vector<bool> grouped(count, false);
+    std::vector<std::vector<uint32_t>> groups;
+    for (uint32_t seed = 0; seed < count; seed++) {
+        if (grouped[seed])
+            continue;
+        std::vector<uint32_t> group{seed};
+        grouped[seed] = true;
+        while (group.size() < CLUSTER_GROUP_SIZE) {
+            uint32_t best = count, best_weight = 0;
+            for (uint32_t member : group)
+                for (uint32_t e = offsets[member]; e < offsets[member + 1];
+                     e++)
+                    if (!grouped[neighbours[e]] && weights[e] > best_weight) {
+                        best = neighbours[e];
+                        best_weight = weights[e];
+                    }
+            if (best == count)
+                break;
+            group.push_back(best);
+            grouped[best] = true;
+        }
+        for (uint32_t &member : group)
+            member = level[member];
+        groups.push_back(std::move(group));
+    }
+    return groups;
+}
+
+// error in pixels over pixel_error, at the sphere's point nearest to eye
+bool too_coarse(const glm::vec3 &eye, const glm::vec3 &center, float radius,
+                float error, float scale) {
+    if (error == INFINITY)
+        return true;
+    float distance = glm::length(center - eye) - radius;
+    if (distance <= 0.0f)
+        return error > 0.0f;
+    return error * scale > distance;
+}
+
+} // namespace
+
+void build_cluster_lod(Mesh &mesh) {
+    mesh.clusters.clear();
+    mesh.cluster_faces.clear();
+    glm::vec3 size = mesh.bounding_box.max - mesh.bounding_box.min;
+    // simplify_groups() errors are relative to the longest side
+    const float extent = glm::max(glm::max(size.x, size.y), size.z);
+
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    if (mesh.parts.empty())
+        ranges.emplace_back(0, mesh.faces.size());
+    for (const MeshPart &part : mesh.parts)
+        ranges.emplace_back(part.first_index, part.index_count);
+    std::vector<uint32_t> level;
+    for (auto [first, count] : ranges) {
+        for (const Meshlet &m : cut_meshlets(mesh, &mesh.faces[first], count)) {
+            level.push_back(mesh.clusters.size());
+            mesh.clusters.push_back(Cluster{first + m.first_index,
+                                            m.index_count, 0, m.center,
+                                            m.radius, 0.0f, glm::vec3(0.0f),
+                                            0.0f, INFINITY});
+        }
+    }
+
+    for (uint32_t depth = 1; level.size() > 1 && depth < MAX_CLUSTER_LEVELS;
+         depth++) {
+        std::vector<std::vector<uint32_t>> groups = group_clusters(mesh, level);
+        std::vector<std::vector<GLuint>> group_faces(groups.size());
+        uint64_t before = 0, after = 0;
+        for (uint64_t g = 0; g < groups.size(); g++) {
+            for (uint32_t c : groups[g]) {
+                const GLuint *indices = cluster_indices(mesh, mesh.clusters[c]);
+                group_faces[g].insert(
+                    group_faces[g].end(), indices,
+                    indices + mesh.clusters[c].index_count);
+            }
+            before += group_faces[g].size();
+        }
+        std::vector<float> errors = simplify_groups(mesh, group_faces, 0.5f);
+        for (const std::vector<GLuint> &faces : group_faces)
+            after += faces.size();
+        // the clusters of this level stay the roots
+        if (after > MIN_LEVEL_REDUCTION * before)
+            break;
+
+        std::vector<uint32_t> next;
+        for (uint64_t g = 0; g < groups.size(); g++) {
+            glm::vec3 lo(1e30f), hi(-1e30f);
+            float error = 0.0f;
+            for (uint32_t c : groups[g]) {
+                const Cluster &cluster = mesh.clusters[c];
+                lo = glm::min(lo, cluster.center - cluster.radius);
+                hi = glm::max(hi, cluster.center + cluster.radius);
+                error = glm::max(error, cluster.error);
+            }
+            glm::vec3 center = (lo + hi) * 0.5f;
+            float radius = 0.0f;
+            for (uint32_t c : groups[g])
+                radius = glm::max(radius,
+                                  glm::length(mesh.clusters[c].center - center) +
+                                      mesh.clusters[c].radius);
+            error += errors[g] * extent;
+            for (uint32_t c : groups[g]) {
+                mesh.clusters[c].parent_center = center;
+                mesh.clusters[c].parent_radius = radius;
+                mesh.clusters[c].parent_error = error;
+            }
+
+            const std::vector<GLuint> &faces = group_faces[g];
+            const uint64_t base = mesh.faces.size() + mesh.cluster_faces.size();
+            for (const Meshlet &m : cut_meshlets(mesh, faces.data(),
+                                                 faces.size())) {
+                next.push_back(mesh.clusters.size());
+                mesh.clusters.push_back(Cluster{base + m.first_index,
+                                                m.index_count, depth, center,
+                                                radius, error, glm::vec3(0.0f),
+                                                0.0f, INFINITY});
+            }
+            mesh.cluster_faces.insert(mesh.cluster_faces.end(), faces.begin(),
+                                      faces.end());
+        }
+        level = std::move(next);
+    }
+}
+
+std::vector<std::pair<uint64_t, uint64_t>>
+visible_clusters(const Mesh &mesh, const glm::mat4 &view_model,
+                 const glm::mat4 &proj, float viewport_height,
+                 float pixel_error) {
+    ViewFrustum frustum(view_model, proj);
+    // error * scale / distance is the error in units of pixel_error;
+    // proj[1][1] is 1 / tan(fovy / 2)
+    const float scale = proj[1][1] * 0.5f * viewport_height / pixel_error;
+    // a single cheap test per cluster, starting threads for it every frame
+    // costs more than it saves
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    for (const Cluster &c : mesh.clusters) {
+        if (too_coarse(frustum.eye, c.center, c.radius, c.error, scale) ||
+            !too_coarse(frustum.eye, c.parent_center, c.parent_radius,
+                        c.parent_error, scale) ||
+            frustum.outside(c.center, c.radius))
+            continue;
+        if (!ranges.empty() &&
+            ranges.back().first + ranges.back().second == c.first_index)
+            ranges.back().second += c.index_count;
+        else
+            ranges.emplace_back(c.first_index, c.index_count);
+    }
+    return ranges;
+}
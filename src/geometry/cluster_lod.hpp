@@ -0,0 +1,43 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include "../mesh.hpp"
+
+// clusters simplified together
+constexpr uint32_t CLUSTER_GROUP_SIZE = 4;
+constexpr uint32_t MAX_CLUSTER_LEVELS = 16;
+
+/*
+    Hierarchical cluster LOD. Level 0 are the faces of every part cut into
+    meshlet sized clusters. Every further level puts the clusters of the
+    last one in groups of CLUSTER_GROUP_SIZE neighbours (those sharing the
+    most vertices), simplifies each group to half its triangles with the
+    vertices shared with other groups locked, and cuts the result into new
+    clusters. Group borders move from level to level, so no edge stays
+    locked for long. It stops at one cluster, at MAX_CLUSTER_LEVELS, or
+    once a level hardly shrinks.
+
+    The clusters made from a group all carry its bounding sphere, which
+    holds the spheres of the group's clusters, and its error: the largest
+    error of the group's clusters plus the group's simplification error.
+    Both only grow towards the roots. The simplified indices take about as
+    much memory again as faces.
+*/
+void build_cluster_lod(Mesh &mesh);
+
+/*
+    Index ranges (first index, index count) into faces followed by
+    cluster_faces of the clusters to draw: those whose own error projects
+    to at most pixel_error pixels while their parent's projects to more,
+    minus those outside the frustum. Errors are projected at the point of
+    their sphere nearest to the eye. All clusters of a group see the same
+    parent numbers and all clusters made from it the same own numbers, so
+    a group is swapped for its simplification as a whole and regions at
+    different levels meet on locked vertices, without cracks.
+*/
+std::vector<std::pair<uint64_t, uint64_t>>
+visible_clusters(const Mesh &mesh, const glm::mat4 &view_model,
+                 const glm::mat4 &proj, float viewport_height,
+                 float pixel_error = 1.0f);
@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <cmath>
+
+#include "meshlets.hpp"
+
+namespace {
+
+// cones wider than this (min dot of axis and normals) are never culled
+constexpr float MIN_CONE_DOT = 0.1f;
+
+void compute_bounds(const Mesh &mesh, const GLuint *faces, Meshlet &meshlet) {
+    faces += meshlet.first_index;
+    glm::vec3 lo(1e30f), hi(-1e30f);
+    for (uint32_t i = 0; i < meshlet.index_count; i++) {
+        lo = glm::min(lo, mesh.positions[faces[i]]);
+        hi = glm::max(hi, mesh.positions[faces[i]]);
+    }
+    meshlet.center = (lo + hi) * 0.5f;
+    meshlet.radius = 0.0f;
+    for (uint32_t i = 0; i < meshlet.index_count; i++)
+        meshlet.radius =
+            glm::max(meshlet.radius,
+                     glm::length(mesh.positions[faces[i]] - meshlet.center));
+
+    std::vector<glm::vec3> normals;
+    glm::vec3 axis(0.0f);
+    for (uint32_t i = 0; i < meshlet.index_count; i += 3) {
+        const glm::vec3 &a = mesh.positions[faces[i]];
+        glm::vec3 n = glm::cross(mesh.positions[faces[i + 1]] - a,
+                                 mesh.positions[faces[i + 2]] - a);
+        float len = glm::length(n);
+        // degenerate triangles are invisible from any side
+        if (len <= 0.0f)
+            continue;
+        normals.push_back(n / len);
+        axis += n / len;
+    }
+    float len = glm::length(axis);
+    meshlet.cone_axis = len > 0.0f ? axis / len : glm::vec3(0.0f, 0.0f, 1.0f);
+    float min_dot = len > 0.0f ? 1.0f : -1.0f;
+    for (const glm::vec3 &n : normals)
+        min_dot = glm::min(min_dot, glm::dot(n, meshlet.cone_axis));
+    // the test against the cutoff then never passes
+    meshlet.cone_cutoff =
+        min_dot <= MIN_CONE_DOT ? 1.0f : std::sqrt(1.0f - min_dot * min_dot);
+}
+
+} // namespace
+
+std::vector<Meshlet> cut_meshlets(const Mesh &mesh, const GLuint *faces,
+                                  uint64_t count) {
+    std::vector<Meshlet> meshlets;
+    // vertices of the current meshlet, few enough for a linear search
+    GLuint vertices[MESHLET_MAX_VERTICES];
+    Meshlet meshlet{0, 0, 0, {}, 0.0f, {}, 0.0f};
+    for (uint64_t i = 0; i < count; i += 3) {
+        const GLuint *tri = &faces[i];
+        auto is_new = [&](int k) {
+            if ((k > 0 && tri[k] == tri[0]) || (k > 1 && tri[k] == tri[1]))
+                return false;
+            return std::find(vertices, vertices + meshlet.vertex_count,
+                             tri[k]) == vertices + meshlet.vertex_count;
+        };
+        uint32_t added = is_new(0) + is_new(1) + is_new(2);
+        if (meshlet.vertex_count + added > MESHLET_MAX_VERTICES ||
+            meshlet.index_count == 3 * MESHLET_MAX_TRIANGLES) {
+            compute_bounds(mesh, faces, meshlet);
+            meshlets.push_back(meshlet);
+            meshlet = Meshlet{i, 0, 0, {}, 0.0f, {}, 0.0f};
+        }
+        for (int k = 0; k < 3; k++)
+            if (is_new(k))
+                vertices[meshlet.vertex_count++] = tri[k];
+        meshlet.index_count += 3;
+    }
+    if (meshlet.index_count > 0) {
+        compute_bounds(mesh, faces, meshlet);
+        meshlets.push_back(meshlet);
+    }
+    return meshlets;
+}
+
+void build_meshlets(Mesh &mesh) {
+    mesh.meshlets.clear();
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    if (mesh.parts.empty())
+        ranges.emplace_back(0, mesh.faces.size());
+    for (const MeshPart &part : mesh.parts)
+        ranges.emplace_back(part.first_index, part.index_count);
+    for (auto [first, count] : ranges) {
+        for (Meshlet meshlet :
+             cut_meshlets(mesh, &mesh.faces[first], count)) {
+            meshlet.first_index += first;
+            mesh.meshlets.push_back(meshlet);
+        }
+    }
+}
+
+ViewFrustum::ViewFrustum(const glm::mat4 &view_model, const glm::mat4 &proj) {
+    // planes from the rows of the clip matrix, a point is inside when
+    // dot(plane, (p, 1)) >= 0 for all six
+    glm::mat4 clip = proj * view_model;
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++)
+        rows[i] = glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+    for (int i = 0; i < 3; i++) {
+        planes[2 * i] = rows[3] + rows[i];
+        planes[2 * i + 1] = rows[3] - rows[i];
+    }
+    for (glm::vec4 &plane : planes)
+        plane /= glm::max(glm::length(glm::vec3(plane)), 1e-30f);
+    eye = glm::vec3(glm::inverse(view_model) *
+                    glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+}
+
+bool ViewFrustum::outside(const glm::vec3 &center, float radius) const {
+    for (const glm::vec4 &plane : planes)
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+            return true;
+    return false;
+}
+
+std::vector<std::pair<uint64_t, uint64_t>>
+visible_meshlets(const Mesh &mesh, const glm::mat4 &view_model,
+                 const glm::mat4 &proj, bool cull_backfaces) {
+    ViewFrustum frustum(view_model, proj);
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    for (const Meshlet &meshlet : mesh.meshlets) {
+        glm::vec3 to_center = meshlet.center - frustum.eye;
+        bool backfacing = cull_backfaces &&
+                          glm::dot(to_center, meshlet.cone_axis) >=
+                          meshlet.cone_cutoff * glm::length(to_center) +
+                              meshlet.radius;
+        if (backfacing || frustum.outside(meshlet.center, meshlet.radius))
+            continue;
+        if (!ranges.empty() && ranges.back().first + ranges.back().second ==
+                                   meshlet.first_index)
+            ranges.back().second += meshlet.index_count;
+        else
+            ranges.emplace_back(meshlet.first_index, meshlet.index_count);
+    }
+    return ranges;
+}
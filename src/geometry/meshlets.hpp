@@ -0,0 +1,48 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include "../mesh.hpp"
+
+// limits of one meshlet, the common mesh shader sizes
+constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+/*
+    Cuts the faces of every part into meshlets in their current order: a
+    meshlet ends when the next triangle would bring it past
+    MESHLET_MAX_VERTICES distinct vertices or MESHLET_MAX_TRIANGLES
+    triangles. After optimize_vertex_cache the order walks the surface in
+    small steps, so the meshlets come out compact; the faces are not moved,
+    every meshlet is a range of them. Bounding spheres and normal cones are
+    computed from the float positions.
+*/
+void build_meshlets(Mesh &mesh);
+
+// the same cut over count indices of any index buffer on the mesh's
+// vertices, first_index relative to faces
+std::vector<Meshlet> cut_meshlets(const Mesh &mesh, const GLuint *faces,
+                                  uint64_t count);
+
+// view frustum and eye of view_model and proj in model space
+struct ViewFrustum {
+    glm::vec4 planes[6];
+    glm::vec3 eye;
+
+    ViewFrustum(const glm::mat4 &view_model, const glm::mat4 &proj);
+    // true when the sphere is entirely outside
+    bool outside(const glm::vec3 &center, float radius) const;
+};
+
+/*
+    Index ranges (first index, index count) of the meshlets that may be
+    visible: inside the frustum of proj * view_model and, with backfaces
+    culled, not entirely facing away from the eye. Back faces show in
+    wireframe and on open meshes, so that test is only right when the
+    renderer culls them or the mesh is closed and filled. Neighbouring
+    visible meshlets are merged into one range.
+*/
+std::vector<std::pair<uint64_t, uint64_t>>
+visible_meshlets(const Mesh &mesh, const glm::mat4 &view_model,
+                 const glm::mat4 &proj, bool cull_backfaces);
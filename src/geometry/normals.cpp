@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#include "normals.hpp"
+#include "../mesh.hpp"
+#include "../parallel.hpp"
+
+namespace {
+
+constexpr uint64_t GRAIN = 1 << 16;
+
+float corner_angle(const glm::vec3 &a, const glm::vec3 &b) {
+    float len = glm::length(a) * glm::length(b);
+    if (len == 0.0f)
+        return 0.0f;
+    return std::acos(glm::clamp(glm::dot(a, b) / len, -1.0f, 1.0f));
+}
+
+} // namespace
+
+void NormalBuilder::rebuild(const Mesh &mesh) {
+    const uint64_t vertex_count = mesh.vertex_count();
+    const uint64_t corner_count = mesh.faces.size();
+
+    // corners per vertex, then turned into write cursors below
+    std::vector<std::atomic<uint32_t>> cursors(vertex_count);
+    parallel_for(corner_count, GRAIN, [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t c = begin; c < end; c++)
+            cursors[mesh.faces[c]].fetch_add(1, std::memory_order_relaxed);
+    });
+
+    // exclusive scan in two passes: per block sums, then per block offsets
+    const uint64_t blocks = (vertex_count + GRAIN - 1) / GRAIN;
+    std::vector<uint32_t> block_start(blocks + 1, 0);
+    parallel_for(blocks, 1, [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t b = begin; b < end; b++) {
+            uint64_t last = std::min(vertex_count, (b + 1) * GRAIN);
+            uint32_t sum = 0;
+            for (uint64_t v = b * GRAIN; v < last; v++)
+                sum += cursors[v].load(std::memory_order_relaxed);
+            block_start[b + 1] = sum;
+        }
+    });
+    for (uint64_t b = 0; b < blocks; b++)
+        block_start[b + 1] += block_start[b];
+    offsets.resize(vertex_count + 1);
+    offsets[vertex_count] = corner_count;
+    parallel_for(blocks, 1, [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t b = begin; b < end; b++) {
+            uint64_t last = std::min(vertex_count, (b + 1) * GRAIN);
+            uint32_t offset = block_start[b];
+            for (uint64_t v = b * GRAIN; v < last; v++) {
+                uint32_t count = cursors[v].load(std::memory_order_relaxed);
+                offsets[v] = offset;
+                cursors[v].store(offset, std::memory_order_relaxed);
+                offset += count;
+            }
+        }
+    });
+
+    corners.resize(corner_count);
+    parallel_for(corner_count, GRAIN, [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t c = begin; c < end; c++)
+            corners[cursors[mesh.faces[c]].fetch_add(
+                1, std::memory_order_relaxed)] = c;
+    });
+    // the scatter order depends on scheduling, sorting keeps the sums (and
+    // so the normals) identical from run to run
+    parallel_for(vertex_count, GRAIN, [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t v = begin; v < end; v++)
+            std::sort(corners.begin() + offsets[v],
+                      corners.begin() + offsets[v + 1]);
+    });
+}
+
+void NormalBuilder::update(Mesh &mesh, NormalWeighting weighting) {
+    if (offsets.size() != mesh.vertex_count() + 1 ||
+        corners.size() != mesh.faces.size())
+        rebuild(mesh);
+
+    const uint64_t face_count = mesh.faces.size() / 3;
+    const bool by_angle = weighting == NormalWeighting::Angle;
+    // per face normal, unit length for angle weighting
+    std::vector<float> face_x(face_count), face_y(face_count),
+        face_z(face_count);
+    // per corner angle, angle weighting only
+    std::vector<float> angles(by_angle ? mesh.faces.size() : 0);
+    parallel_for(face_count, GRAIN, [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t f = begin; f < end; f++) {
+            const glm::vec3 &A = mesh.positions[mesh.faces[3 * f + 0]];
+            const glm::vec3 &B = mesh.positions[mesh.faces[3 * f + 1]];
+            const glm::vec3 &C = mesh.positions[mesh.faces[3 * f + 2]];
+            // twice the area long
+            glm::vec3 n = glm::cross(B - A, C - A);
+            if (by_angle) {
+                float len = glm::length(n);
+                n = len > 0.0f ? n / len : glm::vec3(0.0f);
+                angles[3 * f + 0] = corner_angle(B - A, C - A);
+                angles[3 * f + 1] = corner_angle(C - B, A - B);
+                angles[3 * f + 2] = corner_angle(A - C, B - C);
+            }
+            face_x[f] = n.x;
+            face_y[f] = n.y;
+            face_z[f] = n.z;
+        }
+    });
+
+    parallel_for(mesh.vertex_count(), GRAIN,
+                 [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t v = begin; v < end; v++) {
+            float x = 0.0f, y = 0.0f, z = 0.0f;
+            for (uint32_t i = offsets[v]; i < offsets[v + 1]; i++) {
+                uint32_t c = corners[i], f = c / 3;
+                float w = by_angle ? angles[c] : 1.0f;
+                x += w * face_x[f];
+                y += w * face_y[f];
+                z += w * face_z[f];
+            }
+            float len = std::sqrt(x * x + y * y + z * z);
+            float inv = len > 0.0f ? 1.0f / len : 0.0f;
+            mesh.normals[v] = glm::vec3(x * inv, y * inv, z * inv);
+        }
+    });
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// mesh.hpp keeps a builder on every Mesh
+class Mesh;
+
+enum class NormalWeighting {
+    // bigger faces pull harder, the cheapest
+    Area,
+    // by the face's angle at the vertex, independent of how faces are split
+    Angle,
+};
+
+/*
+    Vertex normals without write conflicts: every face normal is computed
+    once into plain x/y/z arrays, then every vertex sums the faces around it
+    found through a vertex -> corner adjacency in CSR form (offsets into one
+    flat list of corners, corner c belongs to face c / 3). Both passes only
+    write their own elements so they run on all workers, and the flat
+    arrays keep the inner loops simple enough for the compiler to vectorize.
+
+    The adjacency depends only on faces, so every Mesh keeps its builder
+    (Mesh::refresh_normals): update() after moving vertices, rebuild() when
+    faces change. Only the adjacency is kept between calls, the face
+    normals are scratch of update().
+*/
+class NormalBuilder {
+  public:
+    NormalBuilder() = default;
+    explicit NormalBuilder(const Mesh &mesh) { rebuild(mesh); }
+
+    // recomputes the adjacency from mesh.faces
+    void rebuild(const Mesh &mesh);
+    // writes normalized vertex normals into mesh.normals
+    void update(Mesh &mesh, NormalWeighting weighting = NormalWeighting::Area);
+
+    // corners around vertex v are corners[offsets[v], offsets[v + 1])
+    const std::vector<uint32_t> &get_offsets() const { return offsets; }
+    const std::vector<uint32_t> &get_corners() const { return corners; }
+
+  private:
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> corners;
+};
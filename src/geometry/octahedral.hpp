@@ -0,0 +1,28 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+/*
+    Octahedral mapping of unit vectors onto [-1, 1]^2: the vector is
+    projected on the octahedron |x| + |y| + |z| = 1 and the lower half is
+    folded over the upper one. Two small numbers per normal with an error
+    spread evenly over the sphere, unlike quantizing x, y, z directly.
+*/
+inline glm::vec2 octahedral_encode(glm::vec3 n) {
+    float sum = glm::abs(n.x) + glm::abs(n.y) + glm::abs(n.z);
+    if (sum == 0.0f)
+        return glm::vec2(0.0f);
+    n /= sum;
+    if (n.z >= 0.0f)
+        return glm::vec2(n.x, n.y);
+    return glm::vec2((1.0f - glm::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+                     (1.0f - glm::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+}
+
+inline glm::vec3 octahedral_decode(glm::vec2 f) {
+    glm::vec3 n(f.x, f.y, 1.0f - glm::abs(f.x) - glm::abs(f.y));
+    float t = glm::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return glm::normalize(n);
+}
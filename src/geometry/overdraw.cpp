@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <memory>
+
+#include "overdraw.hpp"
+#include "vertex_cache.hpp"
+#include "../parallel.hpp"
+
+namespace {
+
+// same cache as analyze_vertex_cache
+constexpr uint32_t CACHE_SIZE = 16;
+
+struct Cluster {
+    uint64_t first, count;
+    // area weighted
+    glm::vec3 centroid;
+    glm::vec3 normal;
+    float area;
+    float sort_key;
+};
+
+// FIFO cache simulation; the miss counter only grows, so the stamps stay
+// valid across ranges and flush() is a jump of the counter
+class CacheSim {
+  public:
+    explicit CacheSim(uint64_t vertex_count)
+        : loaded_at(vertex_count, 0) {}
+
+    uint32_t misses(const GLuint *tri) {
+        uint32_t count = 0;
+        for (int k = 0; k < 3; k++) {
+            if (counter - loaded_at[tri[k]] <= CACHE_SIZE)
+                continue;
+            loaded_at[tri[k]] = counter++;
+            count++;
+        }
+        return count;
+    }
+    void flush() { counter += CACHE_SIZE + 1; }
+
+  private:
+    std::vector<uint64_t> loaded_at;
+    uint64_t counter = CACHE_SIZE + 1;
+};
+
+void optimize_range(Mesh &mesh, uint64_t first, uint64_t count,
+                    float threshold, CacheSim &cache) {
+    if (count < 2)
+        return;
+    const GLuint *faces = &mesh.faces[3 * first];
+    cache.flush();
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < count; i++)
+        total += cache.misses(&faces[3 * i]);
+    const float target = threshold * (float)total / (float)count;
+
+    // a cluster ends once it is as cache friendly as the whole range
+    std::vector<Cluster> clusters;
+    Cluster cluster{0, 0, glm::vec3(0.0f), glm::vec3(0.0f), 0.0f, 0.0f};
+    uint64_t misses = 0;
+    cache.flush();
+    for (uint64_t i = 0; i < count; i++) {
+        const GLuint *tri = &faces[3 * i];
+        misses += cache.misses(tri);
+        const glm::vec3 &a = mesh.positions[tri[0]];
+        const glm::vec3 &b = mesh.positions[tri[1]];
+        const glm::vec3 &c = mesh.positions[tri[2]];
+        glm::vec3 n = glm::cross(b - a, c - a);
+        float area = glm::length(n);
+        cluster.normal += n;
+        cluster.centroid += area * (a + b + c) / 3.0f;
+        cluster.area += area;
+        cluster.count++;
+        if (misses <= target * cluster.count || i + 1 == count) {
+            clusters.push_back(cluster);
+            cluster = Cluster{i + 1, 0, glm::vec3(0.0f), glm::vec3(0.0f),
+                              0.0f, 0.0f};
+            misses = 0;
+            cache.flush();
+        }
+    }
+
+    glm::vec3 center(0.0f);
+    float area = 0.0f;
+    for (const Cluster &c : clusters) {
+        center += c.centroid;
+        area += c.area;
+    }
+    center /= glm::max(area, 1e-30f);
+    for (Cluster &c : clusters) {
+        float len = glm::length(c.normal);
+        // degenerate clusters have no preferred side and keep key 0
+        if (c.area <= 0.0f || len <= 0.0f)
+            continue;
+        c.sort_key =
+            glm::dot(c.centroid / c.area - center, c.normal / len);
+    }
+    std::stable_sort(clusters.begin(), clusters.end(),
+                     [](const Cluster &a, const Cluster &b) {
+                         return a.sort_key > b.sort_key;
+                     });
+
+    std::vector<uint32_t> order;
+    order.reserve(count);
+    for (const Cluster &c : clusters)
+        for (uint64_t i = 0; i < c.count; i++)
+            order.push_back(c.first + i);
+    reorder_triangles(mesh, first, order);
+}
+
+} // namespace
+
+void optimize_overdraw(Mesh &mesh, float threshold) {
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    if (mesh.parts.empty())
+        ranges.emplace_back(0, mesh.faces.size() / 3);
+    for (const MeshPart &part : mesh.parts)
+        ranges.emplace_back(part.first_index / 3, part.index_count / 3);
+    // parts are independent, the simulated cache is per worker
+    std::vector<std::unique_ptr<CacheSim>> caches(num_workers());
+    parallel_for(ranges.size(), 1, [&](uint64_t begin, uint64_t end,
+                                       uint32_t worker) {
+        if (!caches[worker])
+            caches[worker] = std::make_unique<CacheSim>(mesh.vertex_count());
+        for (uint64_t r = begin; r < end; r++)
+            optimize_range(mesh, ranges[r].first, ranges[r].second,
+                           threshold, *caches[worker]);
+    });
+}
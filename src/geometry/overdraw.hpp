@@ -0,0 +1,17 @@
+#pragma once
+
+#include "../mesh.hpp"
+
+/*
+    Reorders the triangles of every part to cut overdraw without undoing
+    optimize_vertex_cache (run that first). The cache ordered triangles are
+    cut into clusters, each ending as soon as it alone, drawn with a cold
+    cache, comes within `threshold` of the part's cache miss ratio. The
+    clusters are then sorted by how far out they sit along their own
+    average normal: outward facing patches on the outside of the part are
+    drawn first and fill the depth buffer, so the GL_LESS depth test
+    rejects more of what is drawn after them, from any view direction.
+
+    threshold 1.05 allows 5% more vertex shader runs than the cache order.
+*/
+void optimize_overdraw(Mesh &mesh, float threshold = 1.05f);
@@ -0,0 +1,656 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include "simplify.hpp"
+#include "cluster_lod.hpp"
+#include "meshlets.hpp"
+#include "overdraw.hpp"
+#include "vertex_cache.hpp"
+#include "../parallel.hpp"
+
+namespace {
+
+// border planes count this much more than the triangle planes
+constexpr float BORDER_WEIGHT = 10.0f;
+// triangles per patch of the parallel pass
+constexpr uint64_t PATCH_TRIANGLES = 1 << 16;
+// patches stop at this many times their share of the target (and at half
+// the error bound), so the merged pass still has their borders to collapse
+constexpr uint64_t PATCH_TARGET_SLACK = 2;
+// cosine of the largest turn of a triangle normal in one collapse
+constexpr float MIN_TURN_COS = 0.25f;
+
+struct Quadric {
+    float a00 = 0.0f, a11 = 0.0f, a22 = 0.0f;
+    float a10 = 0.0f, a20 = 0.0f, a21 = 0.0f;
+    float b0 = 0.0f, b1 = 0.0f, b2 = 0.0f;
+    float c = 0.0f;
+    // sum of the plane weights
+    float w = 0.0f;
+
+    // plane n.x + d = 0, |n| = 1
+    static Quadric plane(const glm::vec3 &n, float d, float weight) {
+        Quadric q;
+        q.a00 = weight * n.x * n.x;
+        q.a11 = weight * n.y * n.y;
+        q.a22 = weight * n.z * n.z;
+        q.a10 = weight * n.y * n.x;
+        q.a20 = weight * n.z * n.x;
+        q.a21 = weight * n.z * n.y;
+        q.b0 = weight * n.x * d;
+        q.b1 = weight * n.y * d;
+        q.b2 = weight * n.z * d;
+        q.c = weight * d * d;
+        q.w = weight;
+        return q;
+    }
+
+    void add(const Quadric &q) {
+        a00 += q.a00, a11 += q.a11, a22 += q.a22;
+        a10 += q.a10, a20 += q.a20, a21 += q.a21;
+        b0 += q.b0, b1 += q.b1, b2 += q.b2;
+        c += q.c;
+        w += q.w;
+    }
+
+    // weighted mean of the squared distances of p to the planes
+    float error(const glm::vec3 &p) const {
+        float e = a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z +
+                  2.0f * (a10 * p.x * p.y + a20 * p.x * p.z +
+                          a21 * p.y * p.z) +
+                  2.0f * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+        return w > 0.0f ? std::fabs(e) / w : 0.0f;
+    }
+};
+
+enum class VertexKind : uint8_t {
+    Manifold,
+    // on an open boundary with exactly two border edges
+    Border,
+    // never moves
+    Locked,
+};
+
+// open boundary edge a->b as it runs in its triangle
+struct BorderEdge {
+    uint32_t a, b, tri;
+};
+
+struct Collapse {
+    uint32_t from, to;
+    float cost;
+};
+
+// part of the faces of one mesh part, simplified on its own
+struct Patch {
+    uint32_t part;
+    std::vector<GLuint> faces;
+    uint64_t target;
+    // squared relative error
+    float error = 0.0f;
+};
+
+// positions are scaled into the unit box, so errors are relative and the
+// float quadrics keep their precision on big coordinates
+struct Frame {
+    glm::vec3 origin;
+    float scale;
+};
+
+class PatchSimplifier {
+  public:
+    PatchSimplifier(const Mesh &_mesh, const std::vector<uint8_t> &_locked,
+                    const SimplifyOptions &_opts, const Frame &_frame)
+        : mesh(_mesh), locked(_locked), opts(_opts), frame(_frame) {}
+
+    // simplifies faces in place, returns the largest collapse cost
+    float run(std::vector<GLuint> &faces, uint64_t target) {
+        build_local(faces);
+        classify();
+        build_quadrics();
+        uint64_t alive = 0;
+        for (uint64_t t = 0; t < dead.size(); t++)
+            alive += !dead[t];
+
+        const float limit = opts.max_error * opts.max_error;
+        float max_cost = 0.0f;
+        while (alive > target) {
+            build_adjacency();
+            std::vector<Collapse> candidates = collect_candidates();
+            std::sort(candidates.begin(), candidates.end(),
+                      [](const Collapse &a, const Collapse &b) {
+                          return a.cost < b.cost;
+                      });
+            // the touched one-rings keep a pass to independent collapses,
+            // the next pass sees the costs of the merged quadrics
+            std::vector<bool> touched(positions.size(), false);
+            uint64_t performed = 0;
+            for (const Collapse &c : candidates) {
+                if (c.cost > limit || alive <= target)
+                    break;
+                if (touched[c.from] || touched[c.to] || flips(c.from, c.to))
+                    continue;
+                collapse(c.from, c.to, touched, alive);
+                max_cost = std::max(max_cost, c.cost);
+                performed++;
+            }
+            if (performed == 0)
+                break;
+        }
+
+        faces.clear();
+        for (uint64_t t = 0; t < dead.size(); t++)
+            if (!dead[t])
+                for (int k = 0; k < 3; k++)
+                    faces.push_back(verts[tris[3 * t + k]]);
+        return max_cost;
+    }
+
+  private:
+    const Mesh &mesh;
+    const std::vector<uint8_t> &locked;
+    const SimplifyOptions &opts;
+    Frame frame;
+
+    // local vertex -> mesh vertex
+    std::vector<GLuint> verts;
+    // local vertex ids, 3 per triangle
+    std::vector<uint32_t> tris;
+    std::vector<bool> dead;
+    std::vector<glm::vec3> positions;
+    std::vector<Quadric> quadrics;
+    std::vector<VertexKind> kinds;
+    // the two border neighbours of Border vertices
+    std::vector<std::array<uint32_t, 2>> border;
+    // border edges in triangle order (a, b) and their triangle
+    std::vector<BorderEdge> border_edges;
+    // live triangles around each vertex, rebuilt every pass
+    std::vector<uint32_t> offsets, adjacency;
+
+    void build_local(const std::vector<GLuint> &faces) {
+        verts = faces;
+        std::sort(verts.begin(), verts.end());
+        verts.erase(std::unique(verts.begin(), verts.end()), verts.end());
+        tris.resize(faces.size());
+        for (uint64_t c = 0; c < faces.size(); c++)
+            tris[c] = std::lower_bound(verts.begin(), verts.end(), faces[c]) -
+                      verts.begin();
+        dead.assign(faces.size() / 3, false);
+        for (uint64_t t = 0; t < dead.size(); t++) {
+            const uint32_t *f = &tris[3 * t];
+            dead[t] = f[0] == f[1] || f[1] == f[2] || f[0] == f[2];
+        }
+        positions.resize(verts.size());
+        for (uint64_t v = 0; v < verts.size(); v++)
+            positions[v] =
+                (mesh.positions[verts[v]] - frame.origin) * frame.scale;
+    }
+
+    void classify() {
+        const uint64_t vertex_count = verts.size();
+        std::vector<uint8_t> lock(vertex_count, 0);
+        std::vector<uint32_t> border_count(vertex_count, 0);
+        border.assign(vertex_count, {UINT32_MAX, UINT32_MAX});
+        border_edges.clear();
+
+        // every edge once per triangle, grouped by its endpoints
+        struct Edge {
+            uint32_t lo, hi, tri;
+            bool forward;
+        };
+        std::vector<Edge> edges;
+        edges.reserve(tris.size());
+        for (uint32_t t = 0; t < dead.size(); t++) {
+            if (dead[t])
+                continue;
+            for (int k = 0; k < 3; k++) {
+                uint32_t a = tris[3 * t + k], b = tris[3 * t + (k + 1) % 3];
+                edges.push_back(
+                    Edge{std::min(a, b), std::max(a, b), t, a < b});
+            }
+        }
+        std::sort(edges.begin(), edges.end(), [](const Edge &x, const Edge &y) {
+            return x.lo != y.lo ? x.lo < y.lo : x.hi < y.hi;
+        });
+        auto add_border = [&](uint32_t v, uint32_t w) {
+            if (border_count[v] < 2)
+                border[v][border_count[v]] = w;
+            border_count[v]++;
+        };
+        for (uint64_t i = 0; i < edges.size();) {
+            uint64_t j = i;
+            while (j < edges.size() && edges[j].lo == edges[i].lo &&
+                   edges[j].hi == edges[i].hi)
+                j++;
+            const Edge &e = edges[i];
+            if (j - i == 1) {
+                add_border(e.lo, e.hi);
+                add_border(e.hi, e.lo);
+                border_edges.push_back(e.forward ? BorderEdge{e.lo, e.hi, e.tri}
+                                                 : BorderEdge{e.hi, e.lo, e.tri});
+            } else if (j - i > 2 || edges[i].forward == edges[i + 1].forward) {
+                // more than two triangles or flipped neighbours
+                lock[e.lo] = lock[e.hi] = 1;
+            }
+            i = j;
+        }
+
+        // attribute seams: split vertices at one position
+        std::vector<uint32_t> by_position(vertex_count);
+        for (uint32_t v = 0; v < vertex_count; v++)
+            by_position[v] = v;
+        auto less = [&](uint32_t a, uint32_t b) {
+            const glm::vec3 &p = mesh.positions[verts[a]];
+            const glm::vec3 &q = mesh.positions[verts[b]];
+            return p.x != q.x ? p.x < q.x : p.y != q.y ? p.y < q.y : p.z < q.z;
+        };
+        std::sort(by_position.begin(), by_position.end(), less);
+        for (uint64_t i = 1; i < vertex_count; i++) {
+            uint32_t a = by_position[i - 1], b = by_position[i];
+            if (!less(a, b))
+                lock[a] = lock[b] = 1;
+        }
+
+        kinds.resize(vertex_count);
+        for (uint32_t v = 0; v < vertex_count; v++) {
+            bool is_border = border_count[v] > 0;
+            if (lock[v] || locked[verts[v]] ||
+                (is_border && (opts.lock_border || border_count[v] != 2)))
+                kinds[v] = VertexKind::Locked;
+            else
+                kinds[v] = is_border ? VertexKind::Border : VertexKind::Manifold;
+        }
+    }
+
+    void build_quadrics() {
+        quadrics.assign(verts.size(), Quadric());
+        for (uint64_t t = 0; t < dead.size(); t++) {
+            if (dead[t])
+                continue;
+            const uint32_t *f = &tris[3 * t];
+            glm::vec3 n = glm::cross(positions[f[1]] - positions[f[0]],
+                                     positions[f[2]] - positions[f[0]]);
+            float len = glm::length(n);
+            if (len <= 0.0f)
+                continue;
+            n /= len;
+            Quadric q = Quadric::plane(n, -glm::dot(n, positions[f[0]]),
+                                       0.5f * len);
+            for (int k = 0; k < 3; k++)
+                quadrics[f[k]].add(q);
+        }
+        // planes through the border edges, perpendicular to the surface
+        for (const BorderEdge &e : border_edges) {
+            const uint32_t *f = &tris[3 * e.tri];
+            glm::vec3 n = glm::cross(positions[f[1]] - positions[f[0]],
+                                     positions[f[2]] - positions[f[0]]);
+            glm::vec3 edge = positions[e.b] - positions[e.a];
+            glm::vec3 side = glm::cross(edge, n);
+            float len = glm::length(side);
+            if (len <= 0.0f)
+                continue;
+            side /= len;
+            Quadric q = Quadric::plane(side, -glm::dot(side, positions[e.a]),
+                                       BORDER_WEIGHT * glm::dot(edge, edge));
+            quadrics[e.a].add(q);
+            quadrics[e.b].add(q);
+        }
+    }
+
+    void build_adjacency() {
+        offsets.assign(verts.size() + 1, 0);
+        for (uint64_t t = 0; t < dead.size(); t++)
+            if (!dead[t])
+                for (int k = 0; k < 3; k++)
+                    offsets[tris[3 * t + k] + 1]++;
+        for (uint64_t v = 0; v < verts.size(); v++)
+            offsets[v + 1] += offsets[v];
+        adjacency.resize(offsets.back());
+        std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+        for (uint32_t t = 0; t < dead.size(); t++)
+            if (!dead[t])
+                for (int k = 0; k < 3; k++)
+                    adjacency[cursor[tris[3 * t + k]]++] = t;
+    }
+
+    bool allowed(uint32_t u, uint32_t v) const {
+        switch (kinds[u]) {
+        case VertexKind::Manifold:
+            return true;
+        case VertexKind::Border:
+            return border[u][0] == v || border[u][1] == v;
+        case VertexKind::Locked:
+            return false;
+        }
+        return false;
+    }
+
+    float cost(uint32_t u, uint32_t v) const {
+        glm::vec3 dn = mesh.normals[verts[u]] - mesh.normals[verts[v]];
+        glm::vec4 dc = mesh.colors[verts[u]] - mesh.colors[verts[v]];
+        return quadrics[u].error(positions[v]) +
+               opts.attribute_weight * (glm::dot(dn, dn) + glm::dot(dc, dc));
+    }
+
+    std::vector<Collapse> collect_candidates() const {
+        std::vector<uint64_t> keys;
+        keys.reserve(3 * dead.size());
+        for (uint64_t t = 0; t < dead.size(); t++) {
+            if (dead[t])
+                continue;
+            for (int k = 0; k < 3; k++) {
+                uint64_t a = tris[3 * t + k], b = tris[3 * t + (k + 1) % 3];
+                keys.push_back(std::min(a, b) << 32 | std::max(a, b));
+            }
+        }
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+        std::vector<Collapse> candidates;
+        candidates.reserve(keys.size());
+        for (uint64_t key : keys) {
+            uint32_t a = key >> 32, b = (uint32_t)key;
+            float ab = allowed(a, b) ? cost(a, b) : INFINITY;
+            float ba = allowed(b, a) ? cost(b, a) : INFINITY;
+            if (ab == INFINITY && ba == INFINITY)
+                continue;
+            candidates.push_back(ab <= ba ? Collapse{a, b, ab}
+                                          : Collapse{b, a, ba});
+        }
+        return candidates;
+    }
+
+    // true when moving u onto v turns a triangle around u over, or close
+    // to it; small turns add up over many collapses
+    bool flips(uint32_t u, uint32_t v) const {
+        for (uint32_t i = offsets[u]; i < offsets[u + 1]; i++) {
+            const uint32_t *f = &tris[3 * adjacency[i]];
+            if (dead[adjacency[i]] || f[0] == v || f[1] == v || f[2] == v)
+                continue;
+            glm::vec3 p[3], q[3];
+            for (int k = 0; k < 3; k++) {
+                p[k] = positions[f[k]];
+                q[k] = f[k] == u ? positions[v] : p[k];
+            }
+            glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+            if (glm::dot(before, after) <
+                MIN_TURN_COS * glm::length(before) * glm::length(after))
+                return true;
+        }
+        return false;
+    }
+
+    void collapse(uint32_t u, uint32_t v, std::vector<bool> &touched,
+                  uint64_t &alive) {
+        for (uint32_t i = offsets[u]; i < offsets[u + 1]; i++) {
+            uint32_t t = adjacency[i];
+            if (dead[t])
+                continue;
+            uint32_t *f = &tris[3 * t];
+            for (int k = 0; k < 3; k++) {
+                touched[f[k]] = true;
+                if (f[k] == u)
+                    f[k] = v;
+            }
+            if (f[0] == f[1] || f[1] == f[2] || f[0] == f[2]) {
+                dead[t] = true;
+                alive--;
+            }
+        }
+        touched[v] = true;
+        quadrics[v].add(quadrics[u]);
+        if (kinds[u] == VertexKind::Border) {
+            // u's other border neighbour and v become neighbours
+            uint32_t w = border[u][0] == v ? border[u][1] : border[u][0];
+            auto replace = [&](uint32_t x, uint32_t from, uint32_t to) {
+                if (kinds[x] != VertexKind::Border)
+                    return;
+                if (border[x][0] == from)
+                    border[x][0] = to;
+                else if (border[x][1] == from)
+                    border[x][1] = to;
+            };
+            replace(v, u, w);
+            replace(w, u, v);
+        }
+        kinds[u] = VertexKind::Locked;
+    }
+};
+
+// vertices used by more than one patch
+std::vector<uint8_t> shared_vertices(uint64_t vertex_count,
+                                     const std::vector<Patch> &patches) {
+    const uint32_t NONE = UINT32_MAX;
+    std::vector<uint32_t> owner(vertex_count, NONE);
+    std::vector<uint8_t> shared(vertex_count, 0);
+    for (uint32_t p = 0; p < patches.size(); p++) {
+        for (GLuint v : patches[p].faces) {
+            if (owner[v] == NONE)
+                owner[v] = p;
+            else if (owner[v] != p)
+                shared[v] = 1;
+        }
+    }
+    return shared;
+}
+
+// simplifies every patch on its own with the shared vertices locked,
+// returns the largest error
+float simplify_patches(const Mesh &mesh, std::vector<Patch> &patches,
+                       const SimplifyOptions &opts, const Frame &frame) {
+    std::vector<uint8_t> locked = shared_vertices(mesh.vertex_count(), patches);
+    parallel_for(patches.size(), 1, [&](uint64_t begin, uint64_t end,
+                                        uint32_t) {
+        for (uint64_t p = begin; p < end; p++) {
+            PatchSimplifier simplifier(mesh, locked, opts, frame);
+            patches[p].error =
+                simplifier.run(patches[p].faces, patches[p].target);
+        }
+    });
+    float error = 0.0f;
+    for (const Patch &patch : patches)
+        error = std::max(error, patch.error);
+    return error;
+}
+
+Frame make_frame(const Mesh &mesh) {
+    AABB box = mesh.bounding_box;
+    if (box.min.x > box.max.x) {
+        for (const glm::vec3 &p : mesh.positions) {
+            box.min = glm::min(box.min, p);
+            box.max = glm::max(box.max, p);
+        }
+    }
+    glm::vec3 size = box.max - box.min;
+    float extent = glm::max(glm::max(size.x, size.y), size.z);
+    return Frame{box.min, extent > 0.0f ? 1.0f / extent : 1.0f};
+}
+
+uint64_t part_target(const SimplifyOptions &opts, uint64_t part_triangles,
+                     uint64_t total_triangles) {
+    if (opts.target_triangles == 0 || total_triangles == 0)
+        return 0;
+    double ratio = (double)opts.target_triangles / (double)total_triangles;
+    return (uint64_t)std::ceil(ratio * (double)part_triangles);
+}
+
+} // namespace
+
+SimplifiedFaces simplify_faces(const Mesh &mesh, const SimplifyOptions &opts) {
+    return simplify_faces(mesh, mesh.faces, mesh.parts, opts);
+}
+
+SimplifiedFaces simplify_faces(const Mesh &mesh,
+                               const std::vector<GLuint> &faces,
+                               const std::vector<MeshPart> &from_parts,
+                               const SimplifyOptions &opts) {
+    const Frame frame = make_frame(mesh);
+    std::vector<MeshPart> parts = from_parts;
+    if (parts.empty())
+        parts.push_back(MeshPart{"", 0, faces.size()});
+    const uint64_t total = faces.size() / 3;
+
+    // one patch per part, or Morton ordered pieces of every part
+    std::vector<Patch> patches;
+    for (uint32_t p = 0; p < parts.size(); p++) {
+        uint64_t first = parts[p].first_index / 3;
+        uint64_t count = parts[p].index_count / 3;
+        if (!opts.parallel || count <= PATCH_TRIANGLES) {
+            const GLuint *f = &faces[3 * first];
+            patches.push_back(Patch{p, std::vector<GLuint>(f, f + 3 * count),
+                                    part_target(opts, count, total)});
+            continue;
+        }
+        std::vector<uint32_t> order =
+            morton_order(mesh, &faces[3 * first], count);
+        for (uint64_t b = 0; b < count; b += PATCH_TRIANGLES) {
+            Patch patch{p, {}, 0};
+            uint64_t n = std::min(PATCH_TRIANGLES, count - b);
+            for (uint64_t i = b; i < b + n; i++)
+                for (int k = 0; k < 3; k++)
+                    patch.faces.push_back(
+                        faces[3 * (first + order[i]) + k]);
+            patch.target = std::min(
+                n, PATCH_TARGET_SLACK * part_target(opts, n, total));
+            patches.push_back(std::move(patch));
+        }
+    }
+    const bool split = patches.size() > parts.size();
+    SimplifyOptions patch_opts = opts;
+    if (split)
+        patch_opts.max_error = 0.5f * opts.max_error;
+    float error = std::sqrt(simplify_patches(mesh, patches, patch_opts, frame));
+
+    // the patch borders were locked, a pass per part cleans them up; its
+    // quadrics only know the simplified surface, so its error adds on top
+    if (split) {
+        std::vector<Patch> merged(parts.size());
+        for (uint32_t p = 0; p < parts.size(); p++) {
+            merged[p].part = p;
+            merged[p].target =
+                part_target(opts, parts[p].index_count / 3, total);
+        }
+        for (Patch &patch : patches)
+            merged[patch.part].faces.insert(merged[patch.part].faces.end(),
+                                            patch.faces.begin(),
+                                            patch.faces.end());
+        patches = std::move(merged);
+        SimplifyOptions merged_opts = opts;
+        merged_opts.max_error = std::max(0.0f, opts.max_error - error);
+        error += std::sqrt(simplify_patches(mesh, patches, merged_opts, frame));
+    }
+
+    SimplifiedFaces result;
+    result.parts = parts;
+    for (MeshPart &part : result.parts)
+        part.index_count = 0;
+    for (const Patch &patch : patches)
+        result.parts[patch.part].index_count += patch.faces.size();
+    uint64_t first = 0;
+    for (MeshPart &part : result.parts) {
+        part.first_index = first;
+        first += part.index_count;
+    }
+    result.faces.resize(first);
+    std::vector<uint64_t> cursor(parts.size());
+    for (uint32_t p = 0; p < parts.size(); p++)
+        cursor[p] = result.parts[p].first_index;
+    for (const Patch &patch : patches) {
+        std::copy(patch.faces.begin(), patch.faces.end(),
+                  result.faces.begin() + cursor[patch.part]);
+        cursor[patch.part] += patch.faces.size();
+    }
+    result.error = error;
+    return result;
+}
+
+std::vector<float> simplify_groups(const Mesh &mesh,
+                                   std::vector<std::vector<GLuint>> &groups,
+                                   float ratio) {
+    SimplifyOptions opts;
+    std::vector<Patch> patches(groups.size());
+    for (uint32_t g = 0; g < groups.size(); g++) {
+        patches[g].part = g;
+        patches[g].faces = std::move(groups[g]);
+        patches[g].target = (uint64_t)std::ceil(
+            ratio * (double)(patches[g].faces.size() / 3));
+    }
+    simplify_patches(mesh, patches, opts, make_frame(mesh));
+    std::vector<float> errors(groups.size());
+    for (uint32_t g = 0; g < groups.size(); g++) {
+        groups[g] = std::move(patches[g].faces);
+        errors[g] = std::sqrt(patches[g].error);
+    }
+    return errors;
+}
+
+float simplify_mesh(Mesh &mesh, const SimplifyOptions &opts) {
+    SimplifiedFaces simplified = simplify_faces(mesh, opts);
+    mesh.faces = std::move(simplified.faces);
+    mesh.parts = std::move(simplified.parts);
+    mesh.triangles.clear();
+    // the old meshlets, levels and clusters no longer match the faces
+    mesh.meshlets.clear();
+    mesh.clusters.clear();
+    mesh.cluster_faces.clear();
+    mesh.lods.clear();
+    mesh.lod_faces.clear();
+    if (mesh.reorder) {
+        optimize_vertex_cache(mesh);
+        optimize_overdraw(mesh);
+    }
+    // the used vertices come first, the rest is cut off
+    optimize_vertex_fetch(mesh);
+    uint64_t used = 0;
+    for (GLuint v : mesh.faces)
+        used = std::max<uint64_t>(used, v + 1);
+    mesh.resize_vertices(used);
+
+    mesh.bounding_box = AABB();
+    for (const glm::vec3 &p : mesh.positions) {
+        mesh.bounding_box.min = glm::min(mesh.bounding_box.min, p);
+        mesh.bounding_box.max = glm::max(mesh.bounding_box.max, p);
+    }
+    mesh.triangles.resize(mesh.faces.size() / 3);
+    parallel_for(mesh.triangles.size(), 1 << 16,
+                 [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t i = begin; i < end; i++) {
+            auto [a, b, c] = mesh.get_triangle_vertices(Triangle{(uint32_t)i, {}});
+            mesh.triangles[i] = Triangle{(uint32_t)i, (a + b + c) / 3.0f};
+        }
+    });
+    // the faces around every kept vertex changed
+    mesh.refresh_normals(true);
+    if (mesh.with_meshlets)
+        build_meshlets(mesh);
+    if (mesh.with_lods)
+        build_lods(mesh);
+    if (mesh.with_cluster_lod)
+        build_cluster_lod(mesh);
+    return simplified.error;
+}
+
+void build_lods(Mesh &mesh) {
+    mesh.lods.clear();
+    mesh.lod_faces.clear();
+    SimplifiedFaces level;
+    const std::vector<GLuint> *faces = &mesh.faces;
+    const std::vector<MeshPart> *parts = &mesh.parts;
+    while (faces->size() / 3 > LOD_MIN_TRIANGLES &&
+           mesh.lods.size() < MAX_LODS) {
+        SimplifyOptions opts;
+        opts.target_triangles = faces->size() / 3 / 2;
+        SimplifiedFaces next = simplify_faces(mesh, *faces, *parts, opts);
+        if (next.faces.size() > faces->size() * 3 / 4)
+            break;
+        next.error += level.error;
+        mesh.lods.push_back(
+            MeshLod{mesh.lod_faces.size(), next.faces.size(), next.error});
+        mesh.lod_faces.insert(mesh.lod_faces.end(), next.faces.begin(),
+                              next.faces.end());
+        level = std::move(next);
+        faces = &level.faces;
+        parts = &level.parts;
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+
+#include "../mesh.hpp"
+
+struct SimplifyOptions {
+    // stop at this many triangles, 0 to only stop on max_error
+    uint64_t target_triangles = 0;
+    // stop before a collapse that moves the surface by more than this,
+    // as a fraction of the longest side of the bounding box
+    float max_error = 1.0f;
+    // open boundaries stay as they are
+    bool lock_border = false;
+    // cost of merging vertices with different normals or colors, added to
+    // the squared (relative) geometric error per unit of squared difference
+    float attribute_weight = 1e-3f;
+    // split every part into patches simplified on all workers with their
+    // shared borders locked, half way to the target, then a serial pass
+    // over the merged result that also collapses the patch borders
+    bool parallel = true;
+};
+
+// index buffer over the vertices of the mesh it was computed from
+struct SimplifiedFaces {
+    std::vector<GLuint> faces;
+    // same parts as the mesh, with their new index ranges
+    std::vector<MeshPart> parts;
+    // largest collapse error, relative like SimplifyOptions::max_error;
+    // with patches the sum of both passes, a bound on the distance to the
+    // input
+    float error = 0.0f;
+};
+
+/*
+    Quadric error edge collapse (Garland-Heckbert). Every vertex carries the
+    sum of the planes of its triangles weighted by their area, open
+    boundaries add planes through the border edges perpendicular to the
+    surface, so borders keep their shape. An edge u->v collapses u onto v,
+    no new vertices are made, which keeps every attribute as it was and lets
+    several levels share one vertex buffer.
+
+    Collapses are done in passes: all edges get the cost of their cheaper
+    direction, are sorted, and taken cheapest first while none of the
+    vertices around them changed in the same pass; collapses that would
+    flip a triangle are skipped. Vertices on an attribute seam (same
+    position, different vertex), on non-manifold edges or on borders
+    touching more than two border edges never move; border vertices only
+    move along the border.
+
+    Parts never lose their shared borders.
+*/
+SimplifiedFaces simplify_faces(const Mesh &mesh, const SimplifyOptions &opts);
+
+// same over another index buffer on the mesh's vertices, e.g. a level
+// simplified before; parts index into faces
+SimplifiedFaces simplify_faces(const Mesh &mesh,
+                               const std::vector<GLuint> &faces,
+                               const std::vector<MeshPart> &parts,
+                               const SimplifyOptions &opts);
+
+// simplifies every index buffer of groups in place to about ratio of its
+// triangles, each on its own and on all workers; vertices used by more than
+// one group are locked, so the groups still fit together afterwards.
+// Returns the error of every group, relative like SimplifyOptions::max_error
+std::vector<float> simplify_groups(const Mesh &mesh,
+                                   std::vector<std::vector<GLuint>> &groups,
+                                   float ratio);
+
+// replaces the mesh's faces by simplify_faces(), drops the vertices no
+// longer used and rebuilds triangles, bounding box, normals, meshlets,
+// levels of detail and cluster hierarchy (the last three as load() would);
+// colors stay those of the remaining vertices. Returns the reached error.
+float simplify_mesh(Mesh &mesh, const SimplifyOptions &opts);
+
+// levels stop above this many triangles
+constexpr uint64_t LOD_MIN_TRIANGLES = 1 << 12;
+constexpr uint32_t MAX_LODS = 8;
+
+// fills mesh.lods and mesh.lod_faces with a chain of coarser index buffers
+// over the mesh's vertices, each simplified from the one before to about
+// half its triangles, until LOD_MIN_TRIANGLES or until locked borders and
+// seams keep a level from getting much smaller. Errors add up along the
+// chain, so every level bounds its distance to the full mesh.
+void build_lods(Mesh &mesh);
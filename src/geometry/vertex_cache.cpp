@@ -0,0 +1,286 @@
+#include <algorithm>
+#include <cmath>
+
+#include "vertex_cache.hpp"
+#include "../parallel.hpp"
+
+namespace {
+
+// size of the LRU cache the scores are tuned for
+constexpr uint32_t FORSYTH_CACHE_SIZE = 32;
+constexpr uint64_t BLOCK_TRIANGLES = 1 << 16;
+
+// Forsyth's constants
+constexpr float CACHE_DECAY_POWER = 1.5f;
+constexpr float LAST_TRI_SCORE = 0.75f;
+constexpr float VALENCE_BOOST_SCALE = 2.0f;
+constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+constexpr uint32_t VALENCE_TABLE_SIZE = 64;
+
+// the scores only depend on small integers, computed once
+struct ScoreTables {
+    float cache[FORSYTH_CACHE_SIZE];
+    float valence[VALENCE_TABLE_SIZE];
+
+    ScoreTables() {
+        for (uint32_t i = 0; i < FORSYTH_CACHE_SIZE; i++) {
+            // the last triangle's vertices get a fixed score so the next
+            // one does not simply reuse its edge and strip along
+            float scale = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+            cache[i] = i < 3 ? LAST_TRI_SCORE
+                             : std::pow(1.0f - (i - 3) * scale,
+                                        CACHE_DECAY_POWER);
+        }
+        for (uint32_t i = 0; i < VALENCE_TABLE_SIZE; i++)
+            valence[i] = valence_boost(i);
+    }
+
+    // vertices with few triangles left are finished off first
+    static float valence_boost(uint32_t live) {
+        return VALENCE_BOOST_SCALE *
+               std::pow((float)std::max(live, 1u), -VALENCE_BOOST_POWER);
+    }
+};
+
+float vertex_score(int32_t cache_pos, uint32_t live) {
+    static const ScoreTables tables;
+    // no triangles left to emit, never worth picking
+    if (live == 0)
+        return -1.0f;
+    float score = cache_pos >= 0 ? tables.cache[cache_pos] : 0.0f;
+    return score + (live < VALENCE_TABLE_SIZE ? tables.valence[live]
+                                              : ScoreTables::valence_boost(live));
+}
+
+// emission order of the count triangles at faces, as indices into them
+std::vector<uint32_t> forsyth_order(const GLuint *faces, uint64_t count) {
+    // block local vertex ids, so the tables are sized by the block
+    std::vector<GLuint> verts(faces, faces + 3 * count);
+    std::sort(verts.begin(), verts.end());
+    verts.erase(std::unique(verts.begin(), verts.end()), verts.end());
+    std::vector<uint32_t> local(3 * count);
+    for (uint64_t c = 0; c < 3 * count; c++)
+        local[c] = std::lower_bound(verts.begin(), verts.end(), faces[c]) -
+                   verts.begin();
+    const uint64_t vertex_count = verts.size();
+
+    // triangles around each vertex, the first live[v] are not emitted yet
+    std::vector<uint32_t> live(vertex_count, 0);
+    for (uint32_t v : local)
+        live[v]++;
+    std::vector<uint32_t> offsets(vertex_count + 1, 0);
+    for (uint64_t v = 0; v < vertex_count; v++)
+        offsets[v + 1] = offsets[v] + live[v];
+    std::vector<uint32_t> adjacency(3 * count);
+    std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+    for (uint64_t c = 0; c < 3 * count; c++)
+        adjacency[cursor[local[c]]++] = c / 3;
+
+    std::vector<int32_t> cache_pos(vertex_count, -1);
+    std::vector<float> vscore(vertex_count);
+    for (uint64_t v = 0; v < vertex_count; v++)
+        vscore[v] = vertex_score(-1, live[v]);
+    std::vector<bool> emitted(count, false);
+
+    std::vector<uint32_t> order;
+    order.reserve(count);
+    uint32_t cache[FORSYTH_CACHE_SIZE + 3];
+    uint32_t cache_size = 0;
+    int64_t best = -1;
+    uint64_t next_unemitted = 0;
+    while (order.size() < count) {
+        // nothing left around the cache, continue with the first triangle
+        // that is left in input order
+        if (best < 0) {
+            while (emitted[next_unemitted])
+                next_unemitted++;
+            best = next_unemitted;
+        }
+        uint32_t t = best;
+        emitted[t] = true;
+        order.push_back(t);
+
+        uint32_t next[FORSYTH_CACHE_SIZE + 3];
+        uint32_t next_size = 0;
+        for (int k = 0; k < 3; k++) {
+            uint32_t v = local[3 * t + k];
+            uint32_t *tris = &adjacency[offsets[v]];
+            // swap the triangle out of the live range
+            for (uint32_t i = 0; i < live[v]; i++) {
+                if (tris[i] == t) {
+                    std::swap(tris[i], tris[live[v] - 1]);
+                    break;
+                }
+            }
+            live[v]--;
+            next[next_size++] = v;
+        }
+        for (uint32_t i = 0; i < cache_size; i++) {
+            uint32_t v = cache[i];
+            if (v != next[0] && v != next[1] && v != next[2])
+                next[next_size++] = v;
+        }
+        // the entries pushed past the end leave the cache but still need
+        // their score lowered
+        for (uint32_t i = 0; i < next_size; i++) {
+            uint32_t v = next[i];
+            cache_pos[v] = i < FORSYTH_CACHE_SIZE ? (int32_t)i : -1;
+            vscore[v] = vertex_score(cache_pos[v], live[v]);
+        }
+        best = -1;
+        float best_score = -1.0f;
+        for (uint32_t i = 0; i < next_size; i++) {
+            uint32_t v = next[i];
+            for (uint32_t j = 0; j < live[v]; j++) {
+                uint32_t tri = adjacency[offsets[v] + j];
+                float score = vscore[local[3 * tri]] +
+                              vscore[local[3 * tri + 1]] +
+                              vscore[local[3 * tri + 2]];
+                if (score > best_score) {
+                    best_score = score;
+                    best = tri;
+                }
+            }
+        }
+        cache_size = std::min(next_size, FORSYTH_CACHE_SIZE);
+        std::copy(next, next + cache_size, cache);
+    }
+    return order;
+}
+
+template <typename T>
+void permute(std::vector<T> &values, const std::vector<GLuint> &remap) {
+    std::vector<T> out(values.size());
+    parallel_for(values.size(), 1 << 16,
+                 [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t i = begin; i < end; i++)
+            out[remap[i]] = values[i];
+    });
+    values.swap(out);
+}
+
+} // namespace
+
+VertexCacheStats analyze_vertex_cache(const Mesh &mesh, uint32_t cache_size) {
+    // a vertex is cached while fewer than cache_size misses happened since
+    // it was loaded
+    const uint64_t NEVER = UINT64_MAX;
+    std::vector<uint64_t> loaded_at(mesh.vertex_count(), NEVER);
+    uint64_t misses = 0, referenced = 0;
+    for (GLuint v : mesh.faces) {
+        if (loaded_at[v] == NEVER)
+            referenced++;
+        else if (misses - loaded_at[v] <= cache_size)
+            continue;
+        loaded_at[v] = misses++;
+    }
+    uint64_t triangles = mesh.faces.size() / 3;
+    return VertexCacheStats{
+        triangles ? (float)misses / triangles : 0.0f,
+        referenced ? (float)misses / referenced : 0.0f};
+}
+
+void optimize_vertex_cache(Mesh &mesh) {
+    const uint64_t triangle_count = mesh.faces.size() / 3;
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    if (mesh.parts.empty())
+        ranges.emplace_back(0, triangle_count);
+    for (const MeshPart &part : mesh.parts)
+        ranges.emplace_back(part.first_index / 3, part.index_count / 3);
+
+    // triangle ranges that may be reordered on their own; big parts are
+    // sorted along a Morton curve first so every block is a compact patch
+    // even when the file order is random
+    std::vector<std::pair<uint64_t, uint64_t>> blocks;
+    for (auto [first, count] : ranges) {
+        if (count > BLOCK_TRIANGLES) {
+            const GLuint *faces = &mesh.faces[3 * first];
+            reorder_triangles(mesh, first, morton_order(mesh, faces, count));
+        }
+        for (uint64_t b = 0; b < count; b += BLOCK_TRIANGLES)
+            blocks.emplace_back(first + b,
+                                std::min(BLOCK_TRIANGLES, count - b));
+    }
+    parallel_for(blocks.size(), 1, [&](uint64_t begin, uint64_t end,
+                                       uint32_t) {
+        for (uint64_t b = begin; b < end; b++) {
+            auto [first, count] = blocks[b];
+            reorder_triangles(mesh, first,
+                              forsyth_order(&mesh.faces[3 * first], count));
+        }
+    });
+}
+
+// spreads the low 10 bits of x to every third bit
+static uint32_t spread_bits(uint32_t x) {
+    x &= 0x3ff;
+    x = (x | (x << 16)) & 0x030000ff;
+    x = (x | (x << 8)) & 0x0300f00f;
+    x = (x | (x << 4)) & 0x030c30c3;
+    x = (x | (x << 2)) & 0x09249249;
+    return x;
+}
+
+std::vector<uint32_t> morton_order(const Mesh &mesh, const GLuint *faces,
+                                   uint64_t count) {
+    auto centroid = [&](uint64_t t) {
+        const GLuint *f = &faces[3 * t];
+        return (mesh.positions[f[0]] + mesh.positions[f[1]] +
+                mesh.positions[f[2]]) / 3.0f;
+    };
+    glm::vec3 lo(1e30f), hi(-1e30f);
+    for (uint64_t t = 0; t < count; t++) {
+        lo = glm::min(lo, centroid(t));
+        hi = glm::max(hi, centroid(t));
+    }
+    glm::vec3 scale = 1023.0f / glm::max(hi - lo, glm::vec3(1e-20f));
+    std::vector<std::pair<uint32_t, uint32_t>> keys(count);
+    parallel_for(count, 1 << 16, [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t t = begin; t < end; t++) {
+            glm::uvec3 q((centroid(t) - lo) * scale);
+            keys[t] = {spread_bits(q.x) | spread_bits(q.y) << 1 |
+                           spread_bits(q.z) << 2,
+                       (uint32_t)t};
+        }
+    });
+    std::sort(keys.begin(), keys.end());
+    std::vector<uint32_t> order(count);
+    for (uint64_t t = 0; t < count; t++)
+        order[t] = keys[t].second;
+    return order;
+}
+
+void reorder_triangles(Mesh &mesh, uint64_t first,
+                       const std::vector<uint32_t> &order) {
+    const uint64_t count = order.size();
+    GLuint *faces = &mesh.faces[3 * first];
+    std::vector<GLuint> old(faces, faces + 3 * count);
+    for (uint64_t i = 0; i < count; i++)
+        for (int k = 0; k < 3; k++)
+            faces[3 * i + k] = old[3 * order[i] + k];
+    if (mesh.triangles.size() != mesh.faces.size() / 3)
+        return;
+    std::vector<Triangle> old_tris(mesh.triangles.begin() + first,
+                                   mesh.triangles.begin() + first + count);
+    for (uint64_t i = 0; i < count; i++)
+        mesh.triangles[first + i] =
+            Triangle{(uint32_t)(first + i), old_tris[order[i]].centroid};
+}
+
+void optimize_vertex_fetch(Mesh &mesh) {
+    const GLuint UNUSED = UINT32_MAX;
+    std::vector<GLuint> remap(mesh.vertex_count(), UNUSED);
+    GLuint next = 0;
+    for (GLuint &v : mesh.faces) {
+        if (remap[v] == UNUSED)
+            remap[v] = next++;
+        v = remap[v];
+    }
+    for (GLuint &r : remap)
+        if (r == UNUSED)
+            r = next++;
+    permute(mesh.positions, remap);
+    permute(mesh.normals, remap);
+    permute(mesh.colors, remap);
+}
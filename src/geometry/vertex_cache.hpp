@@ -0,0 +1,45 @@
+#pragma once
+
+#include "../mesh.hpp"
+
+// simulated post-transform cache behaviour of an index buffer
+struct VertexCacheStats {
+    // average cache miss ratio, vertex shader runs per triangle: 3 for no
+    // reuse at all, around 0.5-0.7 for a well ordered closed mesh
+    float acmr;
+    // vertex shader runs per referenced vertex, 1 is the ideal
+    float atvr;
+};
+
+// FIFO cache of cache_size entries, about what current GPUs behave like
+VertexCacheStats analyze_vertex_cache(const Mesh &mesh,
+                                      uint32_t cache_size = 16);
+
+/*
+    Reorders the triangles of every part for the post-transform vertex
+    cache with Tom Forsyth's linear-speed algorithm: vertices are scored by
+    their position in a simulated LRU cache and by how few unemitted
+    triangles still use them, and the next triangle is the best scoring one
+    around the vertices just emitted.
+
+    Parts bigger than a block of 2^16 triangles are first sorted along a
+    Morton curve of the centroids, then every block is ordered on its own
+    on all workers; the seams between blocks cost a few misses each. Part
+    ranges stay where they are. Triangles, if already built, follow their
+    faces.
+*/
+void optimize_vertex_cache(Mesh &mesh);
+
+// the count triangles of faces (over the mesh's vertices) sorted along a
+// Morton curve of their centroids, as indices into faces
+std::vector<uint32_t> morton_order(const Mesh &mesh, const GLuint *faces,
+                                   uint64_t count);
+
+// moves triangle first + order[i] to position first + i; triangles, if
+// already built, follow their faces
+void reorder_triangles(Mesh &mesh, uint64_t first,
+                       const std::vector<uint32_t> &order);
+
+// renumbers vertices in order of first use in faces so the vertex fetches
+// of a draw walk the vertex buffer forward; unused vertices go last
+void optimize_vertex_fetch(Mesh &mesh);
@@ -0,0 +1,283 @@
+#include <algorithm>
+#include <cstring>
+
+#include "weld.hpp"
+#include "../parallel.hpp"
+#include "../raytracer/kdtree.hpp"
+
+namespace {
+
+struct WeldKey {
+    uint32_t x, y, z;
+    bool operator==(const WeldKey &other) const {
+        return x == other.x && y == other.y && z == other.z;
+    }
+};
+
+// exact match on the bits, with -0 folded into +0
+WeldKey weld_key(const glm::vec3 &p) {
+    WeldKey key;
+    glm::vec3 q = p + glm::vec3(0.0f);
+    std::memcpy(&key, &q, sizeof(key));
+    return key;
+}
+
+uint32_t hash_key(const WeldKey &key) {
+    uint64_t h = key.x * 0x9E3779B97F4A7C15ull;
+    h ^= (h >> 29) ^ (key.y * 0xBF58476D1CE4E5B9ull);
+    h ^= (h >> 31) ^ (key.z * 0x94D049BB133111EBull);
+    h ^= h >> 32;
+    return (uint32_t)h;
+}
+
+/*
+    Stable parallel compaction of [0, count): keep(i) tells which items
+    survive, the result maps every kept item to its new index and the
+    return value is the number kept.
+*/
+template <typename Keep>
+uint64_t compact_indices(uint64_t count, Keep &&keep,
+                         ScratchVector<uint32_t> &new_index) {
+    const uint64_t chunk = 1 << 16;
+    const uint64_t chunks = (count + chunk - 1) / chunk;
+    std::vector<uint64_t> offsets(chunks + 1, 0);
+    parallel_for(chunks, 1, [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t c = begin; c < end; c++)
+            for (uint64_t i = c * chunk; i < glm::min(count, (c + 1) * chunk);
+                 i++)
+                offsets[c + 1] += keep(i);
+    });
+    for (uint64_t c = 0; c < chunks; c++)
+        offsets[c + 1] += offsets[c];
+    new_index.resize(count);
+    parallel_for(chunks, 1, [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t c = begin; c < end; c++) {
+            uint64_t next = offsets[c];
+            for (uint64_t i = c * chunk; i < glm::min(count, (c + 1) * chunk);
+                 i++)
+                new_index[i] = keep(i) ? next++ : UINT32_MAX;
+        }
+    });
+    return offsets[chunks];
+}
+
+// groups bitwise equal positions
+void remap_exact(const Mesh &mesh, Arena &arena,
+                 ScratchVector<uint32_t> &remap) {
+    const uint64_t count = mesh.vertex_count();
+    ScratchVector<WeldKey> keys(count, &arena);
+    ScratchVector<uint32_t> hashes(count, &arena);
+    parallel_for(count, 1 << 16, [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t i = begin; i < end; i++) {
+            keys[i] = weld_key(mesh.positions[i]);
+            hashes[i] = hash_key(keys[i]);
+        }
+    });
+
+    // scatter the vertices into partitions, keeping file order inside each
+    // partition so the first vertex of a group always wins
+    const uint32_t partitions = 4 * num_workers();
+    auto partition_of = [&](uint64_t i) {
+        return (uint32_t)(((uint64_t)hashes[i] * partitions) >> 32);
+    };
+    const uint64_t chunk = 1 << 16;
+    const uint64_t chunks = (count + chunk - 1) / chunk;
+    ScratchVector<uint64_t> cursor(chunks * partitions, 0, &arena);
+    parallel_for(chunks, 1, [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t c = begin; c < end; c++)
+            for (uint64_t i = c * chunk; i < glm::min(count, (c + 1) * chunk);
+                 i++)
+                cursor[c * partitions + partition_of(i)]++;
+    });
+    std::vector<uint64_t> partition_start(partitions + 1, 0);
+    uint64_t running = 0;
+    for (uint32_t p = 0; p < partitions; p++) {
+        partition_start[p] = running;
+        for (uint64_t c = 0; c < chunks; c++) {
+            uint64_t n = cursor[c * partitions + p];
+            cursor[c * partitions + p] = running;
+            running += n;
+        }
+    }
+    partition_start[partitions] = running;
+    ScratchVector<uint32_t> order(count, &arena);
+    parallel_for(chunks, 1, [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t c = begin; c < end; c++)
+            for (uint64_t i = c * chunk; i < glm::min(count, (c + 1) * chunk);
+                 i++)
+                order[cursor[c * partitions + partition_of(i)]++] = i;
+    });
+
+    parallel_for(partitions, 1, [&](uint64_t begin, uint64_t end, uint32_t) {
+        std::vector<uint32_t> table;
+        for (uint64_t p = begin; p < end; p++) {
+            uint64_t size = partition_start[p + 1] - partition_start[p];
+            uint64_t capacity = 16;
+            while (capacity < 2 * size)
+                capacity <<= 1;
+            table.assign(capacity, UINT32_MAX);
+            const uint64_t mask = capacity - 1;
+            for (uint64_t j = partition_start[p]; j < partition_start[p + 1];
+                 j++) {
+                uint32_t v = order[j];
+                uint64_t slot = hashes[v] & mask;
+                while (table[slot] != UINT32_MAX &&
+                       !(keys[table[slot]] == keys[v]))
+                    slot = (slot + 1) & mask;
+                if (table[slot] == UINT32_MAX)
+                    table[slot] = v;
+                remap[v] = table[slot];
+            }
+        }
+    });
+}
+
+/*
+    Groups vertices closer than epsilon, and chains of them: every vertex
+    looks up all vertices within epsilon in a k-d tree, on all workers, and
+    the pairs found go into a union-find. The root of every set is its
+    lowest index, so the first vertex in file order still wins.
+*/
+void remap_nearby(const Mesh &mesh, float epsilon,
+                  ScratchVector<uint32_t> &remap) {
+    const uint64_t count = mesh.vertex_count();
+    KDTree tree = KDTree::from_vertices(mesh);
+    // (lower, higher) index pairs within epsilon, per worker
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> pairs(
+        num_workers());
+    parallel_for(count, 1 << 12, [&](uint64_t begin, uint64_t end,
+                                     uint32_t worker) {
+        std::vector<Neighbor> close;
+        for (uint64_t i = begin; i < end; i++) {
+            close.clear();
+            tree.within_radius(mesh.positions[i], epsilon, close);
+            for (const Neighbor &n : close)
+                if (n.idx < i)
+                    pairs[worker].emplace_back(n.idx, (uint32_t)i);
+        }
+    });
+    for (uint64_t i = 0; i < count; i++)
+        remap[i] = i;
+    auto find = [&](uint32_t v) {
+        while (remap[v] != v) {
+            remap[v] = remap[remap[v]];
+            v = remap[v];
+        }
+        return v;
+    };
+    for (const auto &worker_pairs : pairs) {
+        for (auto [lo, hi] : worker_pairs) {
+            uint32_t a = find(lo), b = find(hi);
+            if (a != b)
+                remap[std::max(a, b)] = std::min(a, b);
+        }
+    }
+    // parents have lower indices, so they are flattened first
+    for (uint64_t i = 0; i < count; i++)
+        remap[i] = remap[remap[i]];
+}
+
+// keeps the values of the vertices that are their group's first
+template <typename T>
+void compact_attribute(std::vector<T> &values,
+                       const ScratchVector<uint32_t> &remap,
+                       const ScratchVector<uint32_t> &new_index,
+                       uint64_t kept) {
+    std::vector<T> compacted(kept);
+    parallel_for(remap.size(), 1 << 16,
+                 [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t i = begin; i < end; i++)
+            if (remap[i] == i)
+                compacted[new_index[i]] = values[i];
+    });
+    values = std::move(compacted);
+}
+
+} // namespace
+
+bool is_unindexed(const Mesh &mesh) {
+    return !mesh.faces.empty() && mesh.faces.size() == mesh.vertex_count();
+}
+
+uint64_t weld_vertices(Mesh &mesh, float epsilon) {
+    ScratchArenas scratch;
+    return weld_vertices(mesh, epsilon, scratch);
+}
+
+uint64_t weld_vertices(Mesh &mesh, float epsilon, ScratchArenas &scratch) {
+    // exact duplicates first: the copies of a soup's corners are merged by
+    // hash and the tree only sees the distinct positions
+    uint64_t removed = 0;
+    if (epsilon > 0.0f) {
+        removed = weld_vertices(mesh, 0.0f, scratch);
+        scratch.release();
+    }
+    const uint64_t count = mesh.vertex_count();
+    if (count == 0)
+        return removed;
+    // every temporary is sized once and allocated on this thread, the
+    // workers only fill them
+    scratch.ensure(1);
+    Arena &arena = scratch[0];
+
+    // remap[i] is the first vertex of i's group
+    ScratchVector<uint32_t> remap(count, &arena);
+    if (epsilon > 0.0f)
+        remap_nearby(mesh, epsilon, remap);
+    else
+        remap_exact(mesh, arena, remap);
+    ScratchVector<uint32_t> new_index(&arena);
+    uint64_t kept = compact_indices(
+        count, [&](uint64_t i) { return remap[i] == i; }, new_index);
+    compact_attribute(mesh.positions, remap, new_index, kept);
+    compact_attribute(mesh.normals, remap, new_index, kept);
+    compact_attribute(mesh.colors, remap, new_index, kept);
+
+    const uint64_t tri_count = mesh.faces.size() / 3;
+    parallel_for(mesh.faces.size(), 1 << 16,
+                 [&](uint64_t begin, uint64_t end, uint32_t) {
+                     for (uint64_t i = begin; i < end; i++)
+                         mesh.faces[i] = new_index[remap[mesh.faces[i]]];
+                 });
+
+    auto non_degenerate = [&](uint64_t t) {
+        const GLuint *f = &mesh.faces[3 * t];
+        return f[0] != f[1] && f[1] != f[2] && f[2] != f[0];
+    };
+    ScratchVector<uint32_t> new_tri(&arena);
+    uint64_t kept_tris = compact_indices(tri_count, non_degenerate, new_tri);
+    if (kept_tris != tri_count) {
+        std::vector<GLuint> faces(3 * kept_tris);
+        parallel_for(tri_count, 1 << 16,
+                     [&](uint64_t begin, uint64_t end, uint32_t) {
+                         for (uint64_t t = begin; t < end; t++)
+                             if (new_tri[t] != UINT32_MAX)
+                                 for (int k = 0; k < 3; k++)
+                                     faces[3 * new_tri[t] + k] =
+                                         mesh.faces[3 * t + k];
+                     });
+        mesh.faces = std::move(faces);
+        // parts lose their dropped triangles; they are in order, so every
+        // triangle is looked at once
+        for (MeshPart &part : mesh.parts) {
+            uint64_t first = part.first_index / 3;
+            uint64_t last = first + part.index_count / 3;
+            uint64_t t = first;
+            while (t < last && new_tri[t] == UINT32_MAX)
+                t++;
+            uint64_t new_first = t < last ? new_tri[t] : UINT64_MAX;
+            uint64_t part_kept = 0;
+            for (; t < last; t++)
+                part_kept += new_tri[t] != UINT32_MAX;
+            // an emptied part sits where the next kept triangle goes
+            if (new_first == UINT64_MAX) {
+                while (t < tri_count && new_tri[t] == UINT32_MAX)
+                    t++;
+                new_first = t < tri_count ? new_tri[t] : kept_tris;
+            }
+            part.first_index = 3 * new_first;
+            part.index_count = 3 * part_kept;
+        }
+    }
+    return removed + count - kept;
+}
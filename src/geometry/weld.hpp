@@ -0,0 +1,28 @@
+#pragma once
+
+#include "../arena.hpp"
+#include "../mesh.hpp"
+
+/*
+    Merges vertices closer than epsilon (epsilon 0 merges only bitwise
+    equal positions, which is what STL duplicates are) and rewrites faces
+    to the merged indices. Triangles
+    that collapse to a line or point are dropped and the parts' ranges
+    shrink with them. The first vertex of each group, in file order, keeps
+    its color.
+
+    Exact welds hash the vertices on all workers and scatter them into
+    partitions by hash, then every partition is deduplicated in its own
+    open addressing table, so no table is shared between threads. Epsilon
+    welds run the exact weld first, then merge every pair of the remaining
+    vertices within epsilon found by radius queries in a k-d tree.
+
+    Returns the number of vertices removed.
+*/
+uint64_t weld_vertices(Mesh &mesh, float epsilon = 0.0f);
+// same, with the temporaries taken from the caller's import scratch
+uint64_t weld_vertices(Mesh &mesh, float epsilon, ScratchArenas &scratch);
+
+// true for triangle soups (every face corner has its own vertex), the
+// layout STL files load into
+bool is_unindexed(const Mesh &mesh);
@@ -0,0 +1,88 @@
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include "chunk_index.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr uint32_t CHUNK_INDEX_VERSION = 1;
+
+struct ChunkIndexHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t node_count;
+    uint32_t chunk_count;
+    AABB bounding_box;
+    glm::vec3 center;
+    glm::mat4 model_matrix;
+};
+
+} // namespace
+
+bool ChunkIndex::write(const std::string &filepath) const {
+    std::ofstream file(filepath, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "ERROR::CHUNKS::CANNOT_OPEN::" << filepath << std::endl;
+        return false;
+    }
+    ChunkIndexHeader header{{'M', 'S', 'H', 'C'},
+                            CHUNK_INDEX_VERSION,
+                            (uint32_t)nodes.size(),
+                            (uint32_t)chunks.size(),
+                            bounding_box,
+                            center,
+                            model_matrix};
+    file.write((const char *)&header, sizeof(header));
+    file.write((const char *)nodes.data(), nodes.size() * sizeof(ChunkNode));
+    file.write((const char *)chunks.data(),
+               chunks.size() * sizeof(ChunkRecord));
+    return file.good();
+}
+
+bool ChunkIndex::read(const std::string &filepath) {
+    std::ifstream file(filepath, std::ios::binary);
+    ChunkIndexHeader header;
+    if (!file.is_open() ||
+        !file.read((char *)&header, sizeof(header))) {
+        std::cerr << "ERROR::CHUNKS::CANNOT_READ::" << filepath << std::endl;
+        return false;
+    }
+    if (std::memcmp(header.magic, "MSHC", 4) != 0 ||
+        header.version != CHUNK_INDEX_VERSION || header.node_count == 0) {
+        std::cerr << "ERROR::CHUNKS::BAD_HEADER::" << filepath << std::endl;
+        return false;
+    }
+    nodes.resize(header.node_count);
+    chunks.resize(header.chunk_count);
+    file.read((char *)nodes.data(), nodes.size() * sizeof(ChunkNode));
+    file.read((char *)chunks.data(), chunks.size() * sizeof(ChunkRecord));
+    if (!file) {
+        std::cerr << "ERROR::CHUNKS::TRUNCATED::" << filepath << std::endl;
+        return false;
+    }
+    for (const ChunkNode &node : nodes) {
+        bool ok = node.isleaf() ? node.chunk < chunks.size()
+                                : node.children[0] < nodes.size() &&
+                                      node.children[1] < nodes.size();
+        if (!ok) {
+            std::cerr << "ERROR::CHUNKS::BAD_NODE::" << filepath << std::endl;
+            return false;
+        }
+    }
+    bounding_box = header.bounding_box;
+    center = header.center;
+    model_matrix = header.model_matrix;
+    return true;
+}
+
+std::string chunk_filepath(const std::string &index_path, uint32_t chunk) {
+    char suffix[32];
+    std::snprintf(suffix, sizeof(suffix), "_%05u.mesher", chunk);
+    fs::path path(index_path);
+    return (path.parent_path() / (path.stem().string() + suffix)).string();
+}
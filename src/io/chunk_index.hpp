@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "../mesh.hpp"
+
+/*
+    Index of a mesh split into spatial chunks for out-of-core viewing
+    (.mshc). Every chunk is a plain .mesher file next to the index, named
+    "<index stem>_<chunk id>.mesher", with its own welded buffers and BVH.
+
+        header   "MSHC", version, node and chunk counts, bounding box,
+                 center and model matrix of the whole mesh
+        nodes    binary tree over the chunks, node 0 is the root
+        chunks   bounding box, triangle count and file size per chunk
+
+    Chunk vertices stay in the coordinates of the source, the index model
+    matrix places all of them.
+*/
+constexpr uint32_t NO_CHUNK = UINT32_MAX;
+
+struct ChunkNode {
+    AABB box;
+    // NO_CHUNK for inner nodes
+    uint32_t chunk;
+    // both valid for inner nodes, unused for leaves
+    uint32_t children[2];
+    bool isleaf() const { return chunk != NO_CHUNK; }
+};
+
+struct ChunkRecord {
+    AABB box;
+    uint64_t triangle_count;
+    // size of the .mesher file, what the chunk costs once resident
+    uint64_t file_size;
+};
+
+struct ChunkIndex {
+    AABB bounding_box;
+    glm::vec3 center{0.0f};
+    glm::mat4 model_matrix{1.0f};
+    std::vector<ChunkNode> nodes;
+    std::vector<ChunkRecord> chunks;
+
+    bool write(const std::string &filepath) const;
+    bool read(const std::string &filepath);
+};
+
+// path of chunk `chunk` of the index at index_path
+std::string chunk_filepath(const std::string &index_path, uint32_t chunk);
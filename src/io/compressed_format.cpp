@@ -0,0 +1,304 @@
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "compressed_format.hpp"
+#include "mapped_file.hpp"
+#include "rans.hpp"
+#include "../geometry/octahedral.hpp"
+#include "../parallel.hpp"
+
+namespace {
+
+constexpr uint32_t MESHZ_VERSION = 1;
+constexpr uint64_t CHUNK_SIZE = 1 << 16;
+constexpr uint32_t FLAG_COLORS = 1;
+
+struct MeshzHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t position_bits;
+    uint32_t flags;
+    uint64_t vertex_count;
+    uint64_t index_count;
+    AABB bounding_box;
+};
+
+uint32_t zigzag(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+int32_t unzigzag(uint32_t v) { return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+
+void put_varint(std::vector<uint8_t> &out, uint32_t v) {
+    while (v >= 0x80) {
+        out.push_back((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    out.push_back(v);
+}
+
+bool get_varint(const uint8_t *&p, const uint8_t *end, uint32_t &v) {
+    v = 0;
+    for (int shift = 0; shift < 35 && p < end; shift += 7) {
+        uint8_t b = *p++;
+        v |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// octahedral coordinates mapped to [0, 255]
+void encode_octahedral(const glm::vec3 &n, uint8_t out[2]) {
+    glm::vec2 p = glm::clamp(octahedral_encode(n), -1.0f, 1.0f);
+    out[0] = (uint8_t)std::round((p.x * 0.5f + 0.5f) * 255.0f);
+    out[1] = (uint8_t)std::round((p.y * 0.5f + 0.5f) * 255.0f);
+}
+
+glm::vec3 decode_octahedral(const uint8_t in[2]) {
+    return octahedral_decode(
+        glm::vec2(in[0] / 255.0f * 2.0f - 1.0f, in[1] / 255.0f * 2.0f - 1.0f));
+}
+
+struct Quantizer {
+    glm::vec3 min, step;
+    uint32_t max_q;
+    Quantizer(const AABB &box, uint32_t bits) {
+        min = box.min;
+        max_q = (uint32_t)((1ull << bits) - 1);
+        glm::vec3 extent = box.max - box.min;
+        for (int i = 0; i < 3; i++)
+            step[i] = extent[i] > 0.0f ? extent[i] / max_q : 1.0f;
+    }
+    uint32_t quantize(float v, int axis) const {
+        float q = std::round((v - min[axis]) / step[axis]);
+        return (uint32_t)glm::clamp(q, 0.0f, (float)max_q);
+    }
+    float dequantize(uint32_t q, int axis) const {
+        return min[axis] + q * step[axis];
+    }
+};
+
+void encode_vertex_chunk(const Mesh &mesh, const Quantizer &quantizer,
+                         bool colors, uint64_t begin, uint64_t end,
+                         std::vector<uint8_t> &out) {
+    std::vector<uint8_t> positions, normals, rgba;
+    int32_t prev[3] = {0, 0, 0};
+    uint8_t prev_normal[2] = {0, 0}, prev_color[4] = {0, 0, 0, 0};
+    for (uint64_t i = begin; i < end; i++) {
+        for (int axis = 0; axis < 3; axis++) {
+            int32_t q = quantizer.quantize(mesh.positions[i][axis], axis);
+            put_varint(positions, zigzag(q - prev[axis]));
+            prev[axis] = q;
+        }
+        uint8_t oct[2];
+        encode_octahedral(mesh.normals[i], oct);
+        for (int k = 0; k < 2; k++) {
+            normals.push_back(oct[k] - prev_normal[k]);
+            prev_normal[k] = oct[k];
+        }
+        if (!colors)
+            continue;
+        for (int k = 0; k < 4; k++) {
+            uint8_t c = (uint8_t)std::round(
+                glm::clamp(mesh.colors[i][k], 0.0f, 1.0f) * 255.0f);
+            rgba.push_back(c - prev_color[k]);
+            prev_color[k] = c;
+        }
+    }
+    rans::encode(positions.data(), positions.size(), out);
+    rans::encode(normals.data(), normals.size(), out);
+    if (colors)
+        rans::encode(rgba.data(), rgba.size(), out);
+}
+
+bool decode_vertex_chunk(const uint8_t *p, const uint8_t *end,
+                         const Quantizer &quantizer, bool colors,
+                         uint64_t begin, uint64_t last, Mesh &mesh) {
+    std::vector<uint8_t> positions, normals, rgba;
+    p = rans::decode(p, end, positions);
+    if (p)
+        p = rans::decode(p, end, normals);
+    if (p && colors)
+        p = rans::decode(p, end, rgba);
+    const uint64_t count = last - begin;
+    if (!p || normals.size() != 2 * count ||
+        (colors && rgba.size() != 4 * count))
+        return false;
+
+    const uint8_t *q = positions.data(), *q_end = q + positions.size();
+    int32_t prev[3] = {0, 0, 0};
+    uint8_t prev_normal[2] = {0, 0}, prev_color[4] = {0, 0, 0, 0};
+    for (uint64_t i = 0; i < count; i++) {
+        const uint64_t v = begin + i;
+        for (int axis = 0; axis < 3; axis++) {
+            uint32_t delta;
+            if (!get_varint(q, q_end, delta))
+                return false;
+            prev[axis] += unzigzag(delta);
+            mesh.positions[v][axis] = quantizer.dequantize(prev[axis], axis);
+        }
+        for (int k = 0; k < 2; k++)
+            prev_normal[k] += normals[2 * i + k];
+        mesh.normals[v] = decode_octahedral(prev_normal);
+        if (!colors)
+            continue;
+        for (int k = 0; k < 4; k++) {
+            prev_color[k] += rgba[4 * i + k];
+            mesh.colors[v][k] = prev_color[k] / 255.0f;
+        }
+    }
+    return true;
+}
+
+void encode_index_chunk(const Mesh &mesh, uint64_t begin, uint64_t end,
+                        std::vector<uint8_t> &out) {
+    std::vector<uint8_t> indices;
+    int64_t prev = 0;
+    for (uint64_t i = begin; i < end; i++) {
+        put_varint(indices, zigzag((int32_t)((int64_t)mesh.faces[i] - prev)));
+        prev = mesh.faces[i];
+    }
+    rans::encode(indices.data(), indices.size(), out);
+}
+
+bool decode_index_chunk(const uint8_t *p, const uint8_t *end, uint64_t begin,
+                        uint64_t last, Mesh &mesh) {
+    std::vector<uint8_t> indices;
+    if (!rans::decode(p, end, indices))
+        return false;
+    const uint8_t *q = indices.data(), *q_end = q + indices.size();
+    int64_t prev = 0;
+    for (uint64_t i = begin; i < last; i++) {
+        uint32_t delta;
+        if (!get_varint(q, q_end, delta))
+            return false;
+        prev += unzigzag(delta);
+        if (prev < 0 || (uint64_t)prev >= mesh.vertex_count())
+            return false;
+        mesh.faces[i] = prev;
+    }
+    return true;
+}
+
+uint64_t chunk_count(uint64_t n) { return (n + CHUNK_SIZE - 1) / CHUNK_SIZE; }
+
+} // namespace
+
+bool write_meshz(const std::string &filepath, const Mesh &mesh,
+                 uint32_t position_bits) {
+    position_bits = glm::clamp(position_bits, 1u, 24u);
+    bool colors = false;
+    for (const glm::vec4 &color : mesh.colors)
+        if (color != DEFAULT_COLOR) {
+            colors = true;
+            break;
+        }
+    MeshzHeader header{{'M', 'S', 'H', 'Z'},
+                       MESHZ_VERSION,
+                       position_bits,
+                       colors ? FLAG_COLORS : 0,
+                       mesh.vertex_count(),
+                       mesh.faces.size(),
+                       mesh.bounding_box};
+    const Quantizer quantizer(mesh.bounding_box, position_bits);
+
+    // vertex chunks first, then index chunks, each encoded by one worker
+    const uint64_t vertex_chunks = chunk_count(mesh.vertex_count());
+    const uint64_t index_chunks = chunk_count(mesh.faces.size());
+    std::vector<std::vector<uint8_t>> chunks(vertex_chunks + index_chunks);
+    parallel_for(chunks.size(), 1, [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t c = begin; c < end; c++) {
+            if (c < vertex_chunks) {
+                uint64_t first = c * CHUNK_SIZE;
+                uint64_t last =
+                    glm::min<uint64_t>(first + CHUNK_SIZE, mesh.vertex_count());
+                encode_vertex_chunk(mesh, quantizer, colors, first, last,
+                                    chunks[c]);
+            } else {
+                uint64_t first = (c - vertex_chunks) * CHUNK_SIZE;
+                uint64_t last =
+                    glm::min<uint64_t>(first + CHUNK_SIZE, mesh.faces.size());
+                encode_index_chunk(mesh, first, last, chunks[c]);
+            }
+        }
+    });
+
+    // chunk table: where every chunk starts, plus the end of the last one
+    std::vector<uint64_t> offsets(chunks.size() + 1);
+    offsets[0] = sizeof(header) + offsets.size() * sizeof(uint64_t);
+    for (size_t c = 0; c < chunks.size(); c++)
+        offsets[c + 1] = offsets[c] + chunks[c].size();
+
+    std::ofstream file(filepath, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "ERROR::MESHZ::CANNOT_OPEN::" << filepath << std::endl;
+        return false;
+    }
+    file.write((const char *)&header, sizeof(header));
+    file.write((const char *)offsets.data(), offsets.size() * sizeof(uint64_t));
+    for (const auto &chunk : chunks)
+        file.write((const char *)chunk.data(), chunk.size());
+    return file.good();
+}
+
+bool read_meshz(const std::string &filepath, Mesh &mesh) {
+    MappedFile file(filepath);
+    MeshzHeader header;
+    if (!file.is_open() || file.size() < sizeof(header)) {
+        std::cerr << "ERROR::MESHZ::CANNOT_READ::" << filepath << std::endl;
+        return false;
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+    const uint64_t vertex_chunks = chunk_count(header.vertex_count);
+    const uint64_t index_chunks = chunk_count(header.index_count);
+    const uint64_t table_size =
+        (vertex_chunks + index_chunks + 1) * sizeof(uint64_t);
+    if (std::memcmp(header.magic, "MSHZ", 4) != 0 ||
+        header.version != MESHZ_VERSION || header.position_bits == 0 ||
+        header.position_bits > 24 ||
+        file.size() < sizeof(header) + table_size) {
+        std::cerr << "ERROR::MESHZ::BAD_HEADER::" << filepath << std::endl;
+        return false;
+    }
+    std::vector<uint64_t> offsets(vertex_chunks + index_chunks + 1);
+    std::memcpy(offsets.data(), file.data() + sizeof(header), table_size);
+    for (size_t c = 0; c + 1 < offsets.size(); c++)
+        if (offsets[c] > offsets[c + 1] || offsets[c + 1] > file.size()) {
+            std::cerr << "ERROR::MESHZ::BAD_CHUNK_TABLE::" << filepath
+                      << std::endl;
+            return false;
+        }
+
+    const Quantizer quantizer(header.bounding_box, header.position_bits);
+    const bool colors = header.flags & FLAG_COLORS;
+    const uint8_t *base = (const uint8_t *)file.data();
+    mesh.resize_vertices(header.vertex_count);
+    mesh.faces.resize(header.index_count);
+    std::vector<uint8_t> failed(offsets.size() - 1, 0);
+    parallel_for(failed.size(), 1, [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t c = begin; c < end; c++) {
+            const uint8_t *p = base + offsets[c], *p_end = base + offsets[c + 1];
+            bool ok;
+            if (c < vertex_chunks) {
+                uint64_t first = c * CHUNK_SIZE;
+                uint64_t last =
+                    glm::min<uint64_t>(first + CHUNK_SIZE, header.vertex_count);
+                ok = decode_vertex_chunk(p, p_end, quantizer, colors, first,
+                                         last, mesh);
+            } else {
+                uint64_t first = (c - vertex_chunks) * CHUNK_SIZE;
+                uint64_t last =
+                    glm::min<uint64_t>(first + CHUNK_SIZE, header.index_count);
+                ok = decode_index_chunk(p, p_end, first, last, mesh);
+            }
+            failed[c] = !ok;
+        }
+    });
+    for (uint8_t f : failed)
+        if (f) {
+            std::cerr << "ERROR::MESHZ::CORRUPT_CHUNK::" << filepath
+                      << std::endl;
+            return false;
+        }
+    return true;
+}
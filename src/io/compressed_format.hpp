@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+
+#include "../mesh.hpp"
+
+/*
+    Compressed .meshz format for archiving:
+
+    - positions quantized to `position_bits` per axis on the bounding box
+      grid, stored as zigzag varint deltas between consecutive vertices
+    - normals as 8+8 bit octahedral coordinates, colors as RGBA8 (only when
+      some vertex is not the default color), both delta coded per byte
+    - indices as zigzag varint deltas
+
+    Vertices and triangles are cut into chunks of 64k that are delta coded
+    and rANS entropy coded on their own, so both encoding and decoding run
+    one chunk per worker. Triangles and the BVH are rebuilt after loading.
+*/
+bool write_meshz(const std::string &filepath, const Mesh &mesh,
+                 uint32_t position_bits = 16);
+
+// fills vertices (with normals) and faces, the rest is left to the caller
+bool read_meshz(const std::string &filepath, Mesh &mesh);
@@ -0,0 +1,48 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+#include "mapped_file.hpp"
+
+MappedFile::MappedFile(const std::string &filepath) {
+    int fd = open(filepath.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr != MAP_FAILED) {
+            data_ = (const char *)ptr;
+            size_ = st.st_size;
+            // the loaders stream through the whole file once
+            madvise(ptr, size_, MADV_SEQUENTIAL | MADV_WILLNEED);
+        }
+    }
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+}
+
+MappedFile::~MappedFile() { release(); }
+
+MappedFile::MappedFile(MappedFile &&other) noexcept {
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+    if (this != &other) {
+        release();
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+    }
+    return *this;
+}
+
+void MappedFile::release() {
+    if (data_)
+        munmap((void *)data_, size_);
+    data_ = nullptr;
+    size_ = 0;
+}
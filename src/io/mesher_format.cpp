@@ -0,0 +1,296 @@
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include "mesher_format.hpp"
+#include "mapped_file.hpp"
+#include "../parallel.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr uint32_t MESHER_VERSION = 3;
+constexpr uint64_t MESHER_ALIGNMENT = 64;
+
+enum SectionType : uint32_t {
+    SECTION_POSITIONS = 1,
+    SECTION_NORMALS,
+    SECTION_COLORS,
+    SECTION_FACES,
+    SECTION_TRIANGLES,
+    SECTION_BVH_NODES,
+    SECTION_BVH_TRIS,
+    SECTION_PARTS,
+    SECTION_LODS,
+    SECTION_LOD_FACES,
+    SECTION_MESHLETS,
+    SECTION_CLUSTERS,
+    SECTION_CLUSTER_FACES,
+};
+
+// MeshPart without the std::string
+struct PartRecord {
+    uint64_t first_index;
+    uint64_t index_count;
+    char name[48];
+};
+
+// MeshLod with its padding spelled out
+struct LodRecord {
+    uint64_t first_index;
+    uint64_t index_count;
+    float error;
+    uint32_t reserved;
+};
+
+struct MesherHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t section_count;
+    uint32_t reserved;
+    AABB bounding_box;
+    glm::vec3 center;
+    glm::mat4 model_matrix;
+};
+
+struct MesherSection {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+
+uint64_t align(uint64_t offset) {
+    return (offset + MESHER_ALIGNMENT - 1) & ~(MESHER_ALIGNMENT - 1);
+}
+
+template <typename T>
+bool read_section(const MappedFile &file, const MesherSection &section,
+                  std::vector<T> &out) {
+    if (section.offset + section.size > file.size() ||
+        section.size % sizeof(T) != 0)
+        return false;
+    out.resize(section.size / sizeof(T));
+    std::memcpy((void *)out.data(), file.data() + section.offset,
+                section.size);
+    return true;
+}
+
+// true when every index is below `limit`, each worker keeps the largest index
+// of its chunks so a corrupt cache fails here instead of on the GPU
+bool indices_below(const std::vector<uint32_t> &indices, uint64_t limit) {
+    std::vector<uint32_t> largest(num_workers(), 0);
+    parallel_for(indices.size(), 1 << 16,
+                 [&](uint64_t begin, uint64_t end, uint32_t worker) {
+                     uint32_t top = largest[worker];
+                     for (uint64_t i = begin; i < end; i++)
+                         top = std::max(top, indices[i]);
+                     largest[worker] = top;
+                 });
+    return indices.empty() ||
+           *std::max_element(largest.begin(), largest.end()) < limit;
+}
+
+} // namespace
+
+bool write_mesher(const std::string &filepath, const Mesh &mesh,
+                  const BVH &bvh) {
+    std::vector<PartRecord> parts(mesh.parts.size());
+    for (size_t i = 0; i < parts.size(); i++) {
+        parts[i] = PartRecord{mesh.parts[i].first_index,
+                              mesh.parts[i].index_count, {}};
+        // truncated, the last byte stays 0
+        mesh.parts[i].name.copy(parts[i].name, sizeof(parts[i].name) - 1);
+    }
+    std::vector<LodRecord> lods(mesh.lods.size());
+    for (size_t i = 0; i < lods.size(); i++)
+        lods[i] = LodRecord{mesh.lods[i].first_index, mesh.lods[i].index_count,
+                            mesh.lods[i].error, 0};
+    struct Blob {
+        uint32_t type;
+        const void *data;
+        uint64_t size;
+    };
+    const Blob blobs[] = {
+        {SECTION_POSITIONS, mesh.positions.data(),
+         mesh.positions.size() * sizeof(glm::vec3)},
+        {SECTION_NORMALS, mesh.normals.data(),
+         mesh.normals.size() * sizeof(glm::vec3)},
+        {SECTION_COLORS, mesh.colors.data(),
+         mesh.colors.size() * sizeof(glm::vec4)},
+        {SECTION_FACES, mesh.faces.data(), mesh.faces.size() * sizeof(GLuint)},
+        {SECTION_TRIANGLES, mesh.triangles.data(),
+         mesh.triangles.size() * sizeof(Triangle)},
+        {SECTION_BVH_NODES, bvh.get_nodes().data(),
+         bvh.get_nodes().size() * sizeof(BVHNode)},
+        {SECTION_BVH_TRIS, bvh.get_tris().data(),
+         bvh.get_tris().size() * sizeof(uint32_t)},
+        {SECTION_PARTS, parts.data(), parts.size() * sizeof(PartRecord)},
+        {SECTION_LODS, lods.data(), lods.size() * sizeof(LodRecord)},
+        {SECTION_LOD_FACES, mesh.lod_faces.data(),
+         mesh.lod_faces.size() * sizeof(GLuint)},
+        {SECTION_MESHLETS, mesh.meshlets.data(),
+         mesh.meshlets.size() * sizeof(Meshlet)},
+        {SECTION_CLUSTERS, mesh.clusters.data(),
+         mesh.clusters.size() * sizeof(Cluster)},
+        {SECTION_CLUSTER_FACES, mesh.cluster_faces.data(),
+         mesh.cluster_faces.size() * sizeof(GLuint)},
+    };
+    const uint32_t count = sizeof(blobs) / sizeof(blobs[0]);
+
+    MesherHeader header{{'M', 'S', 'H', 'R'}, MESHER_VERSION, count, 0,
+                        mesh.bounding_box, mesh.center, mesh.model_matrix};
+    std::vector<MesherSection> table(count);
+    uint64_t offset = align(sizeof(header) + count * sizeof(MesherSection));
+    for (uint32_t i = 0; i < count; i++) {
+        table[i] = MesherSection{blobs[i].type, 0, offset, blobs[i].size};
+        offset = align(offset + blobs[i].size);
+    }
+
+    std::ofstream file(filepath, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "ERROR::MESHER::CANNOT_OPEN::" << filepath << std::endl;
+        return false;
+    }
+    file.write((const char *)&header, sizeof(header));
+    file.write((const char *)table.data(), count * sizeof(MesherSection));
+    const char zeros[MESHER_ALIGNMENT] = {};
+    uint64_t position = sizeof(header) + count * sizeof(MesherSection);
+    for (uint32_t i = 0; i < count; i++) {
+        file.write(zeros, table[i].offset - position);
+        file.write((const char *)blobs[i].data, blobs[i].size);
+        position = table[i].offset + blobs[i].size;
+    }
+    return file.good();
+}
+
+bool read_mesher(const std::string &filepath, Mesh &mesh, BVH *bvh) {
+    MappedFile file(filepath);
+    MesherHeader header;
+    if (!file.is_open() || file.size() < sizeof(header)) {
+        std::cerr << "ERROR::MESHER::CANNOT_READ::" << filepath << std::endl;
+        return false;
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, "MSHR", 4) != 0 ||
+        header.version != MESHER_VERSION ||
+        sizeof(header) + header.section_count * sizeof(MesherSection) >
+            file.size()) {
+        std::cerr << "ERROR::MESHER::BAD_HEADER::" << filepath << std::endl;
+        return false;
+    }
+    std::vector<MesherSection> table(header.section_count);
+    std::memcpy(table.data(), file.data() + sizeof(header),
+                table.size() * sizeof(MesherSection));
+
+    std::vector<BVHNode> nodes;
+    std::vector<uint32_t> tris;
+    std::vector<PartRecord> parts;
+    std::vector<LodRecord> lods;
+    bool ok = true;
+    for (const MesherSection &section : table) {
+        switch (section.type) {
+        case SECTION_POSITIONS:
+            ok &= read_section(file, section, mesh.positions);
+            break;
+        case SECTION_NORMALS:
+            ok &= read_section(file, section, mesh.normals);
+            break;
+        case SECTION_COLORS:
+            ok &= read_section(file, section, mesh.colors);
+            break;
+        case SECTION_FACES:
+            ok &= read_section(file, section, mesh.faces);
+            break;
+        case SECTION_TRIANGLES:
+            ok &= read_section(file, section, mesh.triangles);
+            break;
+        case SECTION_BVH_NODES:
+            if (bvh)
+                ok &= read_section(file, section, nodes);
+            break;
+        case SECTION_BVH_TRIS:
+            if (bvh)
+                ok &= read_section(file, section, tris);
+            break;
+        case SECTION_PARTS:
+            ok &= read_section(file, section, parts);
+            break;
+        case SECTION_LODS:
+            ok &= read_section(file, section, lods);
+            break;
+        case SECTION_LOD_FACES:
+            ok &= read_section(file, section, mesh.lod_faces);
+            break;
+        case SECTION_MESHLETS:
+            ok &= read_section(file, section, mesh.meshlets);
+            break;
+        case SECTION_CLUSTERS:
+            ok &= read_section(file, section, mesh.clusters);
+            break;
+        case SECTION_CLUSTER_FACES:
+            ok &= read_section(file, section, mesh.cluster_faces);
+            break;
+        default:
+            // sections from newer writers are skipped
+            break;
+        }
+    }
+    ok &= mesh.normals.size() == mesh.vertex_count() &&
+          mesh.colors.size() == mesh.vertex_count();
+    if (!ok || (bvh && nodes.empty())) {
+        std::cerr << "ERROR::MESHER::BAD_SECTION::" << filepath << std::endl;
+        return false;
+    }
+    // caches written before parts were stored hold one unnamed part
+    if (parts.empty())
+        parts.push_back(PartRecord{0, mesh.faces.size(), {}});
+    mesh.parts.clear();
+    for (const PartRecord &part : parts) {
+        std::string name(part.name, strnlen(part.name, sizeof(part.name)));
+        mesh.parts.push_back(
+            MeshPart{name, part.first_index, part.index_count});
+    }
+    ok &= mesh.parts_cover_faces();
+    for (const Meshlet &meshlet : mesh.meshlets)
+        ok &= meshlet.first_index + meshlet.index_count <= mesh.faces.size();
+    for (const Cluster &cluster : mesh.clusters)
+        ok &= cluster.first_index + cluster.index_count <=
+              mesh.faces.size() + mesh.cluster_faces.size();
+    ok &= indices_below(mesh.faces, mesh.vertex_count()) &&
+          indices_below(mesh.lod_faces, mesh.vertex_count()) &&
+          indices_below(mesh.cluster_faces, mesh.vertex_count());
+    if (bvh)
+        ok &= indices_below(tris, mesh.faces.size() / 3);
+    if (!ok) {
+        std::cerr << "ERROR::MESHER::BAD_SECTION::" << filepath << std::endl;
+        return false;
+    }
+    // caches without levels of detail draw the full mesh at any distance
+    mesh.lods.clear();
+    for (const LodRecord &lod : lods) {
+        if (lod.first_index + lod.index_count > mesh.lod_faces.size())
+            break;
+        mesh.lods.push_back(
+            MeshLod{lod.first_index, lod.index_count, lod.error});
+    }
+    mesh.bounding_box = header.bounding_box;
+    mesh.center = header.center;
+    mesh.model_matrix = header.model_matrix;
+    if (bvh)
+        *bvh = BVH(mesh, std::move(nodes), std::move(tris));
+    return true;
+}
+
+std::string find_mesher_cache(const std::string &source) {
+    std::error_code ec;
+    std::string cache = source + ".mesher";
+    if (!fs::exists(cache, ec))
+        return "";
+    auto cache_time = fs::last_write_time(cache, ec);
+    if (ec || cache_time < fs::last_write_time(source, ec) || ec)
+        return "";
+    return cache;
+}
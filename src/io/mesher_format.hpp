@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+
+#include "../mesh.hpp"
+#include "../raytracer/bvh.hpp"
+
+/*
+    Native .mesher container, a snapshot of a fully processed mesh:
+
+        header   "MSHR", version, section count, bounding box, center and
+                 model matrix
+        table    one entry per section (type, offset, size in bytes)
+        sections welded positions, normals and colors, faces (the EBO),
+                 triangles, BVH nodes, BVH triangle order, the parts'
+                 index ranges, the levels of detail with their index
+                 buffers, the meshlets and the cluster hierarchy with its
+                 index buffer, each aligned to 64 bytes
+
+    Reading is one mmap and one memcpy per section, nothing is parsed or
+    recomputed. The layout follows the in-memory structs, so the version
+    has to be bumped when any of them changes.
+*/
+bool write_mesher(const std::string &filepath, const Mesh &mesh,
+                  const BVH &bvh);
+
+// bvh may be null when only the mesh is wanted
+bool read_mesher(const std::string &filepath, Mesh &mesh, BVH *bvh);
+
+// "<source>.mesher" when it exists and is newer than the source, else empty
+std::string find_mesher_cache(const std::string &source);
@@ -0,0 +1,194 @@
+#include <iostream>
+
+#include "obj.hpp"
+#include "text.hpp"
+
+namespace {
+
+struct ObjPart {
+    ScratchVector<glm::vec3> positions;
+    ScratchVector<glm::vec4> colors;
+    // 0-based indices, absolute unless listed in `relative`
+    ScratchVector<int64_t> faces;
+    // positions in faces holding an index relative to the part's first
+    // vertex, they may point into earlier parts
+    ScratchVector<uint64_t> relative;
+    bool failed = false;
+
+    explicit ObjPart(Arena &arena)
+        : positions(&arena), colors(&arena), faces(&arena), relative(&arena) {}
+};
+
+bool parse_vertex(const char *p, const char *end, ObjPart &part) {
+    glm::vec3 position;
+    for (int i = 0; i < 3; i++)
+        if (!text::parse_number(p, end, position[i]))
+            return false;
+    // optional per vertex color
+    glm::vec3 color;
+    if (text::parse_number(p, end, color[0]) &&
+        text::parse_number(p, end, color[1]) &&
+        text::parse_number(p, end, color[2]))
+        part.colors.push_back(glm::vec4(color, 1.0f));
+    else
+        part.colors.push_back(DEFAULT_COLOR);
+    part.positions.push_back(position);
+    return true;
+}
+
+bool parse_face(const char *p, const char *end, ObjPart &part,
+                std::vector<int64_t> &polygon,
+                std::vector<uint8_t> &is_relative) {
+    polygon.clear();
+    is_relative.clear();
+    for (p = text::skip_space(p, end); p < end; p = text::skip_space(p, end)) {
+        int64_t idx;
+        if (!text::parse_number(p, end, idx) || idx == 0)
+            return false;
+        if (idx > 0) {
+            polygon.push_back(idx - 1);
+            is_relative.push_back(0);
+        } else {
+            polygon.push_back((int64_t)part.positions.size() + idx);
+            is_relative.push_back(1);
+        }
+        // texture and normal indices are not used
+        while (p < end && !text::is_space(*p))
+            p++;
+    }
+    if (polygon.size() < 3)
+        return false;
+    for (size_t i = 1; i + 1 < polygon.size(); i++) {
+        for (size_t k : {(size_t)0, i, i + 1}) {
+            if (is_relative[k])
+                part.relative.push_back(part.faces.size());
+            part.faces.push_back(polygon[k]);
+        }
+    }
+    return true;
+}
+
+// counts what the range adds to the part's arrays, so each is allocated
+// once in the arena instead of growing into it by doubling
+void reserve_range(const char *p, const char *range_end, const char *file_end,
+                   ObjPart &part) {
+    uint64_t vertices = 0, corners = 0, relative = 0;
+    for (; p < range_end; p = text::next_line(p, file_end)) {
+        const char *end = text::line_end(p, file_end);
+        const char *q = p;
+        if (text::match_word(q, end, "v")) {
+            vertices++;
+            continue;
+        }
+        if (!text::match_word(q, end, "f"))
+            continue;
+        uint64_t count = 0;
+        bool has_relative = false;
+        for (q = text::skip_space(q, end); q < end;
+             q = text::skip_space(q, end)) {
+            has_relative |= *q == '-';
+            count++;
+            while (q < end && !text::is_space(*q))
+                q++;
+        }
+        if (count < 3)
+            continue;
+        corners += 3 * (count - 2);
+        // a fan repeats polygon corners, all of them may be relative
+        if (has_relative)
+            relative += 3 * (count - 2);
+    }
+    part.positions.reserve(vertices);
+    part.colors.reserve(vertices);
+    part.faces.reserve(corners);
+    part.relative.reserve(relative);
+}
+
+void parse_range(const char *p, const char *range_end, const char *file_end,
+                 ObjPart &part) {
+    reserve_range(p, range_end, file_end, part);
+    std::vector<int64_t> polygon;
+    std::vector<uint8_t> is_relative;
+    for (; p < range_end; p = text::next_line(p, file_end)) {
+        const char *end = text::line_end(p, file_end);
+        const char *q = p;
+        bool ok = true;
+        if (text::match_word(q, end, "v"))
+            ok = parse_vertex(q, end, part);
+        else if (text::match_word(q, end, "f"))
+            ok = parse_face(q, end, part, polygon, is_relative);
+        if (!ok) {
+            part.failed = true;
+            return;
+        }
+    }
+}
+
+} // namespace
+
+bool load_obj(const MappedFile &file, Mesh &mesh, ScratchArenas &scratch) {
+    if (!file.is_open())
+        return false;
+    const char *file_end = file.data() + file.size();
+    auto bounds = text::split_lines(file.data(), file_end);
+    // one arena per range, only the thread parsing the range touches it
+    scratch.ensure(bounds.size() - 1);
+    std::vector<ObjPart> parts;
+    parts.reserve(bounds.size() - 1);
+    for (size_t i = 0; i + 1 < bounds.size(); i++)
+        parts.emplace_back(scratch[i]);
+    parallel_for(parts.size(), 1, [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t i = begin; i < end; i++)
+            parse_range(bounds[i], bounds[i + 1], file_end, parts[i]);
+    });
+
+    std::vector<ScratchVector<glm::vec3>> positions;
+    std::vector<ScratchVector<glm::vec4>> colors;
+    std::vector<uint64_t> face_offsets(parts.size() + 1, 0);
+    for (size_t i = 0; i < parts.size(); i++) {
+        if (parts[i].failed) {
+            std::cerr << "ERROR::OBJ::MALFORMED_LINE" << std::endl;
+            return false;
+        }
+        // moves keep the arena
+        positions.push_back(std::move(parts[i].positions));
+        colors.push_back(std::move(parts[i].colors));
+        face_offsets[i + 1] = face_offsets[i] + parts[i].faces.size();
+    }
+    auto vertex_offsets = text::concat(positions, mesh.positions);
+    text::concat(colors, mesh.colors);
+    mesh.resize_vertices(mesh.positions.size());
+
+    const int64_t vertex_count = mesh.vertex_count();
+    mesh.faces.resize(face_offsets.back());
+    std::vector<uint8_t> out_of_range(parts.size(), 0);
+    parallel_for(parts.size(), 1, [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t i = begin; i < end; i++) {
+            const ObjPart &part = parts[i];
+            size_t next_relative = 0;
+            for (size_t j = 0; j < part.faces.size(); j++) {
+                int64_t idx = part.faces[j];
+                if (next_relative < part.relative.size() &&
+                    part.relative[next_relative] == j) {
+                    idx += vertex_offsets[i];
+                    next_relative++;
+                }
+                if (idx < 0 || idx >= vertex_count) {
+                    out_of_range[i] = 1;
+                    break;
+                }
+                mesh.faces[face_offsets[i] + j] = idx;
+            }
+        }
+    });
+    for (uint8_t f : out_of_range)
+        if (f) {
+            std::cerr << "ERROR::OBJ::INDEX_OUT_OF_RANGE" << std::endl;
+            return false;
+        }
+    if (mesh.faces.empty()) {
+        std::cerr << "ERROR::OBJ::NO_FACES" << std::endl;
+        return false;
+    }
+    return true;
+}
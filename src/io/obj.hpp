@@ -0,0 +1,14 @@
+#pragma once
+
+#include "../arena.hpp"
+#include "../mesh.hpp"
+#include "mapped_file.hpp"
+
+/*
+    Wavefront OBJ, reads "v x y z [r g b]" and "f" lines (any of the
+    a, a/b, a//c, a/b/c forms, negative indices, polygons fanned into
+    triangles) and ignores everything else. Line ranges are parsed on all
+    workers into scratch; relative indices are rebased once every range
+    knows how many vertices come before it.
+*/
+bool load_obj(const MappedFile &file, Mesh &mesh, ScratchArenas &scratch);
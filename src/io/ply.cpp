@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+#include "ply.hpp"
+#include "text.hpp"
+
+namespace {
+
+struct PlyProperty {
+    std::string name;
+    bool is_list = false;
+    // 8 bit color channels are scaled to [0, 1]
+    bool is_uchar = false;
+};
+
+struct PlyElement {
+    std::string name;
+    uint64_t count = 0;
+    std::vector<PlyProperty> properties;
+};
+
+bool is_uchar(std::string_view type) {
+    return type == "uchar" || type == "uint8";
+}
+
+// returns the start of the body, nullptr if the header is not ascii ply
+const char *parse_header(const char *p, const char *end,
+                         std::vector<PlyElement> &elements) {
+    if (!text::match_word(p, end, "ply"))
+        return nullptr;
+    for (p = text::next_line(p, end); p < end; p = text::next_line(p, end)) {
+        const char *line_end = text::line_end(p, end);
+        std::string_view keyword = text::next_word(p, line_end);
+        if (keyword == "format") {
+            if (text::next_word(p, line_end) != "ascii")
+                return nullptr;
+        } else if (keyword == "element") {
+            PlyElement element;
+            element.name = text::next_word(p, line_end);
+            if (!text::parse_number(p, line_end, element.count))
+                return nullptr;
+            elements.push_back(element);
+        } else if (keyword == "property") {
+            if (elements.empty())
+                return nullptr;
+            PlyProperty property;
+            std::string_view type = text::next_word(p, line_end);
+            if (type == "list") {
+                property.is_list = true;
+                text::next_word(p, line_end); // count type
+                text::next_word(p, line_end); // item type
+            } else {
+                property.is_uchar = is_uchar(type);
+            }
+            property.name = text::next_word(p, line_end);
+            elements.back().properties.push_back(property);
+        } else if (keyword == "end_header") {
+            return text::next_line(p, end);
+        }
+    }
+    return nullptr;
+}
+
+struct PlyLayout {
+    // element index of "vertex" and "face", -1 if missing
+    int vertex = -1, face = -1;
+    // property slot of x, y, z, red, green, blue, alpha in a vertex line
+    int slots[7] = {-1, -1, -1, -1, -1, -1, -1};
+    bool uchar_color = false;
+    // first line of every element, plus the total
+    std::vector<uint64_t> first_line;
+};
+
+bool parse_vertex(const char *p, const char *end, const PlyElement &element,
+                  const PlyLayout &layout, glm::vec3 &position,
+                  glm::vec4 &color) {
+    float values[7] = {0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f};
+    for (int i = 0; i < (int)element.properties.size(); i++) {
+        float value;
+        if (!text::parse_number(p, end, value))
+            return false;
+        for (int k = 0; k < 7; k++)
+            if (layout.slots[k] == i)
+                values[k] = (k >= 3 && layout.uchar_color) ? value / 255.0f
+                                                           : value;
+    }
+    position = glm::vec3(values[0], values[1], values[2]);
+    if (layout.slots[3] >= 0)
+        color = glm::vec4(values[3], values[4], values[5], values[6]);
+    return true;
+}
+
+bool parse_face(const char *p, const char *end, const PlyElement &element,
+                ScratchVector<GLuint> &faces, std::vector<GLuint> &polygon) {
+    for (const PlyProperty &property : element.properties) {
+        if (!property.is_list) {
+            text::next_word(p, end);
+            continue;
+        }
+        uint32_t count;
+        if (!text::parse_number(p, end, count))
+            return false;
+        bool indices = property.name == "vertex_indices" ||
+                       property.name == "vertex_index";
+        polygon.clear();
+        for (uint32_t i = 0; i < count; i++) {
+            GLuint idx;
+            if (!text::parse_number(p, end, idx))
+                return false;
+            polygon.push_back(idx);
+        }
+        if (!indices)
+            continue;
+        if (polygon.size() < 3)
+            return false;
+        for (size_t i = 1; i + 1 < polygon.size(); i++) {
+            faces.push_back(polygon[0]);
+            faces.push_back(polygon[i]);
+            faces.push_back(polygon[i + 1]);
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+bool load_ply(const MappedFile &file, Mesh &mesh, ScratchArenas &scratch) {
+    if (!file.is_open())
+        return false;
+    const char *file_end = file.data() + file.size();
+    std::vector<PlyElement> elements;
+    const char *body = parse_header(file.data(), file_end, elements);
+    if (!body)
+        return false;
+
+    PlyLayout layout;
+    layout.first_line.push_back(0);
+    for (int e = 0; e < (int)elements.size(); e++) {
+        layout.first_line.push_back(layout.first_line.back() +
+                                    elements[e].count);
+        if (elements[e].name == "vertex")
+            layout.vertex = e;
+        else if (elements[e].name == "face")
+            layout.face = e;
+    }
+    if (layout.vertex < 0 || layout.face < 0) {
+        std::cerr << "ERROR::PLY::MISSING_VERTEX_OR_FACE" << std::endl;
+        return false;
+    }
+    const PlyElement &vertex_element = elements[layout.vertex];
+    const char *names[7] = {"x", "y", "z", "red", "green", "blue", "alpha"};
+    for (int i = 0; i < (int)vertex_element.properties.size(); i++) {
+        const PlyProperty &property = vertex_element.properties[i];
+        if (property.is_list) {
+            std::cerr << "ERROR::PLY::LIST_IN_VERTEX" << std::endl;
+            return false;
+        }
+        for (int k = 0; k < 7; k++)
+            if (property.name == names[k]) {
+                layout.slots[k] = i;
+                if (k == 3)
+                    layout.uchar_color = property.is_uchar;
+            }
+    }
+    if (layout.slots[0] < 0 || layout.slots[1] < 0 || layout.slots[2] < 0) {
+        std::cerr << "ERROR::PLY::MISSING_POSITION" << std::endl;
+        return false;
+    }
+
+    auto bounds = text::split_lines(body, file_end);
+    const size_t part_count = bounds.size() - 1;
+    // first line number of every range
+    std::vector<uint64_t> line_offsets(part_count + 1, 0);
+    parallel_for(part_count, 1, [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t i = begin; i < end; i++)
+            line_offsets[i + 1] = std::count(bounds[i], bounds[i + 1], '\n');
+    });
+    for (size_t i = 0; i < part_count; i++)
+        line_offsets[i + 1] += line_offsets[i];
+
+    const uint64_t vertex_first = layout.first_line[layout.vertex];
+    const uint64_t vertex_count = vertex_element.count;
+    mesh.resize_vertices(vertex_count);
+    // one arena per range, only the thread parsing the range touches it
+    scratch.ensure(part_count);
+    std::vector<ScratchVector<GLuint>> faces;
+    faces.reserve(part_count);
+    for (size_t i = 0; i < part_count; i++)
+        faces.emplace_back(&scratch[i]);
+    const uint64_t face_first = layout.first_line[layout.face];
+    const uint64_t face_last = layout.first_line[layout.face + 1];
+    std::vector<uint8_t> failed(part_count, 0);
+    parallel_for(part_count, 1, [&](uint64_t begin, uint64_t end, uint32_t) {
+        std::vector<GLuint> polygon;
+        for (uint64_t i = begin; i < end; i++) {
+            // face lines in the range, exact for triangle meshes
+            uint64_t first = std::max(line_offsets[i], face_first);
+            uint64_t last = std::min(line_offsets[i + 1], face_last);
+            if (first < last)
+                faces[i].reserve(3 * (last - first));
+            uint64_t line = line_offsets[i];
+            int element = 0;
+            for (const char *p = bounds[i]; p < bounds[i + 1];
+                 p = text::next_line(p, file_end), line++) {
+                while (element < (int)elements.size() &&
+                       line >= layout.first_line[element + 1])
+                    element++;
+                if (element == (int)elements.size())
+                    break;
+                const char *line_end = text::line_end(p, file_end);
+                bool ok = true;
+                if (element == layout.vertex)
+                    ok = parse_vertex(p, line_end, vertex_element, layout,
+                                      mesh.positions[line - vertex_first],
+                                      mesh.colors[line - vertex_first]);
+                else if (element == layout.face)
+                    ok = parse_face(p, line_end, elements[element], faces[i],
+                                    polygon);
+                if (!ok) {
+                    failed[i] = 1;
+                    break;
+                }
+            }
+        }
+    });
+    for (uint8_t f : failed)
+        if (f) {
+            std::cerr << "ERROR::PLY::MALFORMED_LINE" << std::endl;
+            return false;
+        }
+    // the last line may lack its newline
+    if (line_offsets.back() + 1 < layout.first_line.back()) {
+        std::cerr << "ERROR::PLY::TRUNCATED" << std::endl;
+        return false;
+    }
+    text::concat(faces, mesh.faces);
+    for (GLuint idx : mesh.faces)
+        if (idx >= vertex_count) {
+            std::cerr << "ERROR::PLY::INDEX_OUT_OF_RANGE" << std::endl;
+            return false;
+        }
+    return !mesh.faces.empty();
+}
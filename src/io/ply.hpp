@@ -0,0 +1,18 @@
+#pragma once
+
+#include "../arena.hpp"
+#include "../mesh.hpp"
+#include "mapped_file.hpp"
+
+/*
+    ASCII PLY with a "vertex" element (x, y, z and optional red, green,
+    blue, alpha) and a "face" element with a vertex_indices list, other
+    elements and properties are skipped. Returns false for binary PLY so
+    it can go through Assimp.
+
+    The body is split into line ranges twice: once to count the lines of
+    every range, which tells each range which element its lines belong to,
+    then to parse them. Vertices are written straight to their final slot,
+    faces go through per range scratch sized from the face count.
+*/
+bool load_ply(const MappedFile &file, Mesh &mesh, ScratchArenas &scratch);
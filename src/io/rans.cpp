@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <cstring>
+
+#include "rans.hpp"
+
+namespace rans {
+
+constexpr uint32_t SCALE_BITS = 12;
+constexpr uint32_t SCALE = 1u << SCALE_BITS;
+// lower bound of the normalized state interval
+constexpr uint32_t RANS_L = 1u << 23;
+
+// scales the histogram to sum SCALE, every present symbol keeps freq >= 1
+static void normalize(const uint32_t counts[256], uint32_t total,
+                      uint16_t freq[256]) {
+    uint32_t sum = 0, largest = 0;
+    for (int s = 0; s < 256; s++) {
+        freq[s] = 0;
+        if (counts[s] == 0)
+            continue;
+        freq[s] = std::max<uint32_t>(1, (uint64_t)counts[s] * SCALE / total);
+        sum += freq[s];
+        if (counts[s] > counts[largest])
+            largest = s;
+    }
+    // rounding leftovers go to (or come from) the most frequent symbol, the
+    // others are trimmed in the rare case it cannot absorb them alone
+    int32_t diff = (int32_t)SCALE - (int32_t)sum;
+    if ((int32_t)freq[largest] + diff >= 1) {
+        freq[largest] += diff;
+        return;
+    }
+    freq[largest] = 1;
+    sum = 0;
+    for (int s = 0; s < 256; s++)
+        sum += freq[s];
+    for (int s = 0; sum > SCALE; s = (s + 1) % 256)
+        if (freq[s] > 1) {
+            freq[s]--;
+            sum--;
+        }
+}
+
+void encode(const uint8_t *data, uint32_t size, std::vector<uint8_t> &out) {
+    size_t header = out.size();
+    out.resize(header + 8);
+    std::memcpy(&out[header], &size, 4);
+    if (size == 0) {
+        uint32_t zero = 0;
+        std::memcpy(&out[header + 4], &zero, 4);
+        return;
+    }
+
+    uint32_t counts[256] = {};
+    for (uint32_t i = 0; i < size; i++)
+        counts[data[i]]++;
+    uint16_t freq[256];
+    normalize(counts, size, freq);
+    uint32_t cum[257];
+    cum[0] = 0;
+    for (int s = 0; s < 256; s++)
+        cum[s + 1] = cum[s] + freq[s];
+    size_t table = out.size();
+    out.resize(table + sizeof(freq));
+    std::memcpy(&out[table], freq, sizeof(freq));
+
+    // rANS encodes back to front, the bytes are reversed at the end
+    std::vector<uint8_t> coded;
+    coded.reserve(size + 16);
+    uint32_t x = RANS_L;
+    for (uint32_t i = size; i-- > 0;) {
+        uint8_t s = data[i];
+        uint32_t x_max = ((RANS_L >> SCALE_BITS) << 8) * freq[s];
+        while (x >= x_max) {
+            coded.push_back(x & 0xff);
+            x >>= 8;
+        }
+        x = ((x / freq[s]) << SCALE_BITS) + (x % freq[s]) + cum[s];
+    }
+    for (int k = 0; k < 4; k++) {
+        coded.push_back(x & 0xff);
+        x >>= 8;
+    }
+    std::reverse(coded.begin(), coded.end());
+
+    uint32_t coded_size = coded.size();
+    std::memcpy(&out[header + 4], &coded_size, 4);
+    out.insert(out.end(), coded.begin(), coded.end());
+}
+
+const uint8_t *decode(const uint8_t *in, const uint8_t *end,
+                      std::vector<uint8_t> &out) {
+    uint32_t size, coded_size;
+    if (end - in < 8)
+        return nullptr;
+    std::memcpy(&size, in, 4);
+    std::memcpy(&coded_size, in + 4, 4);
+    in += 8;
+    out.resize(size);
+    if (size == 0)
+        return in;
+
+    uint16_t freq[256];
+    if ((size_t)(end - in) < sizeof(freq) + coded_size || coded_size < 4)
+        return nullptr;
+    std::memcpy(freq, in, sizeof(freq));
+    in += sizeof(freq);
+    uint32_t cum[257];
+    uint8_t lookup[SCALE];
+    cum[0] = 0;
+    for (int s = 0; s < 256; s++) {
+        cum[s + 1] = cum[s] + freq[s];
+        if (cum[s + 1] > SCALE)
+            return nullptr;
+        std::memset(lookup + cum[s], s, freq[s]);
+    }
+    if (cum[256] != SCALE)
+        return nullptr;
+
+    const uint8_t *p = in, *p_end = in + coded_size;
+    uint32_t x = 0;
+    for (int k = 0; k < 4; k++)
+        x = (x << 8) | *p++;
+    for (uint32_t i = 0; i < size; i++) {
+        uint8_t s = lookup[x & (SCALE - 1)];
+        out[i] = s;
+        x = freq[s] * (x >> SCALE_BITS) + (x & (SCALE - 1)) - cum[s];
+        while (x < RANS_L && p < p_end)
+            x = (x << 8) | *p++;
+    }
+    return in + coded_size;
+}
+
+} // namespace rans
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/*
+    Order-0 byte-wise rANS (as in Fabian Giesen's ryg_rans) with a 12 bit
+    probability scale. A block is
+
+        uint32 raw size, uint32 coded size, uint16 freq[256], coded bytes
+
+    where the frequency table is left out for empty blocks. Blocks are
+    self-contained so chunks of a file can be decoded independently.
+*/
+namespace rans {
+
+// appends the encoded block to out
+void encode(const uint8_t *data, uint32_t size, std::vector<uint8_t> &out);
+
+// decodes the block at `in` into out (resized), returns the first byte
+// after the block or nullptr if it does not fit in [in, end)
+const uint8_t *decode(const uint8_t *in, const uint8_t *end,
+                      std::vector<uint8_t> &out);
+
+} // namespace rans
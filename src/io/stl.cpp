@@ -0,0 +1,97 @@
+#include <cstring>
+#include <iostream>
+
+#include "stl.hpp"
+#include "../parallel.hpp"
+#include "text.hpp"
+
+constexpr size_t STL_HEADER_SIZE = 84;
+constexpr size_t STL_RECORD_SIZE = 50;
+
+static uint32_t facet_count(const MappedFile &file) {
+    uint32_t count;
+    std::memcpy(&count, file.data() + 80, sizeof(count));
+    return count;
+}
+
+bool is_binary_stl(const MappedFile &file) {
+    if (!file.is_open() || file.size() < STL_HEADER_SIZE)
+        return false;
+    return file.size() ==
+           STL_HEADER_SIZE + STL_RECORD_SIZE * (uint64_t)facet_count(file);
+}
+
+bool load_binary_stl(const MappedFile &file, Mesh &mesh) {
+    if (!is_binary_stl(file)) {
+        std::cerr << "ERROR::STL::NOT_A_BINARY_STL" << std::endl;
+        return false;
+    }
+    const uint64_t count = facet_count(file);
+    const char *records = file.data() + STL_HEADER_SIZE;
+    mesh.resize_vertices(3 * count);
+    mesh.faces.resize(3 * count);
+    parallel_for(count, 1 << 15, [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t i = begin; i < end; i++) {
+            // records are 50 bytes apart, the floats are not aligned
+            float xyz[9];
+            std::memcpy(xyz, records + i * STL_RECORD_SIZE + 12, sizeof(xyz));
+            for (uint64_t k = 0; k < 3; k++) {
+                mesh.positions[3 * i + k] =
+                    glm::vec3(xyz[3 * k], xyz[3 * k + 1], xyz[3 * k + 2]);
+                mesh.faces[3 * i + k] = 3 * i + k;
+            }
+        }
+    });
+    return true;
+}
+
+bool load_ascii_stl(const MappedFile &file, Mesh &mesh,
+                    ScratchArenas &scratch) {
+    const char *file_end = file.data() + file.size();
+    auto bounds = text::split_lines(file.data(), file_end);
+    // one arena per range, only the thread parsing the range touches it
+    scratch.ensure(bounds.size() - 1);
+    std::vector<ScratchVector<glm::vec3>> parts;
+    parts.reserve(bounds.size() - 1);
+    for (size_t i = 0; i + 1 < bounds.size(); i++)
+        parts.emplace_back(&scratch[i]);
+    std::vector<uint8_t> failed(parts.size(), 0);
+    parallel_for(parts.size(), 1, [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t i = begin; i < end; i++) {
+            // a "vertex x y z" line takes at least 13 bytes, so this is the
+            // only allocation; pages past the real count are never touched
+            parts[i].reserve((bounds[i + 1] - bounds[i]) / 13 + 1);
+            for (const char *p = bounds[i]; p < bounds[i + 1];
+                 p = text::next_line(p, file_end)) {
+                if (!text::match_word(p, file_end, "vertex"))
+                    continue;
+                glm::vec3 v;
+                if (!text::parse_number(p, file_end, v.x) ||
+                    !text::parse_number(p, file_end, v.y) ||
+                    !text::parse_number(p, file_end, v.z)) {
+                    failed[i] = 1;
+                    break;
+                }
+                parts[i].push_back(v);
+            }
+        }
+    });
+    for (uint8_t f : failed)
+        if (f) {
+            std::cerr << "ERROR::STL::MALFORMED_VERTEX" << std::endl;
+            return false;
+        }
+    text::concat(parts, mesh.positions);
+    mesh.resize_vertices(mesh.positions.size());
+    if (mesh.positions.empty() || mesh.positions.size() % 3 != 0) {
+        std::cerr << "ERROR::STL::INCOMPLETE_FACET" << std::endl;
+        return false;
+    }
+    mesh.faces.resize(mesh.positions.size());
+    parallel_for(mesh.faces.size(), 1 << 16,
+                 [&](uint64_t begin, uint64_t end, uint32_t) {
+                     for (uint64_t i = begin; i < end; i++)
+                         mesh.faces[i] = i;
+                 });
+    return true;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "../arena.hpp"
+#include "../mesh.hpp"
+#include "mapped_file.hpp"
+
+/*
+    Binary STL: 80 byte header, uint32 facet count, then one 50 byte record
+    per facet (normal, three vertices as float32 xyz and a uint16 attribute).
+    Some exporters write "solid" in the header of binary files, so the size
+    is what tells binary and ASCII apart.
+*/
+bool is_binary_stl(const MappedFile &file);
+
+// fills the mesh vertices (three per facet) and mesh.faces straight from the
+// mapped records, chunks of facets are decoded on all workers
+bool load_binary_stl(const MappedFile &file, Mesh &mesh);
+
+// ASCII STL, only the "vertex x y z" lines matter: every three of them
+// make a facet. Line ranges are parsed on all workers into scratch and
+// concatenated.
+bool load_ascii_stl(const MappedFile &file, Mesh &mesh,
+                    ScratchArenas &scratch);
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include "../parallel.hpp"
+
+// helpers for the text parsers, they walk [p, end) of a mapped file in place
+namespace text {
+
+inline bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+inline const char *skip_space(const char *p, const char *end) {
+    while (p < end && is_space(*p))
+        p++;
+    return p;
+}
+
+// start of the next line, or end
+inline const char *next_line(const char *p, const char *end) {
+    const char *nl = (const char *)std::memchr(p, '\n', end - p);
+    return nl ? nl + 1 : end;
+}
+
+// end of the current line, excluding the newline
+inline const char *line_end(const char *p, const char *end) {
+    const char *nl = (const char *)std::memchr(p, '\n', end - p);
+    return nl ? nl : end;
+}
+
+// true if the word at p (after spaces) is `word`, p is moved past it
+inline bool match_word(const char *&p, const char *end, const char *word) {
+    const char *q = skip_space(p, end);
+    size_t len = std::strlen(word);
+    if ((size_t)(end - q) < len || std::memcmp(q, word, len) != 0)
+        return false;
+    if (q + len < end && !is_space(q[len]) && q[len] != '\n')
+        return false;
+    p = q + len;
+    return true;
+}
+
+// next whitespace separated word on the line, empty at the line end
+inline std::string_view next_word(const char *&p, const char *end) {
+    p = skip_space(p, end);
+    const char *begin = p;
+    while (p < end && !is_space(*p) && *p != '\n')
+        p++;
+    return std::string_view(begin, p - begin);
+}
+
+template <typename T> inline bool parse_number(const char *&p, const char *end, T &value) {
+    p = skip_space(p, end);
+    // from_chars does not take a leading '+'
+    if (p < end && *p == '+')
+        p++;
+    auto [ptr, ec] = std::from_chars(p, end, value);
+    if (ec != std::errc())
+        return false;
+    p = ptr;
+    return true;
+}
+
+/*
+    Splits [begin, end) into about `parts` ranges that start at the
+    beginning of a line, returned as parts + 1 boundaries (some ranges may
+    be empty).
+*/
+inline std::vector<const char *> split_lines(const char *begin,
+                                             const char *end,
+                                             uint32_t parts) {
+    std::vector<const char *> bounds(parts + 1);
+    bounds[0] = begin;
+    bounds[parts] = end;
+    size_t step = (end - begin) / parts;
+    for (uint32_t i = 1; i < parts; i++) {
+        const char *p = std::max(bounds[i - 1], begin + i * step);
+        bounds[i] = p == begin ? begin : next_line(p - 1, end);
+    }
+    return bounds;
+}
+
+// splits the text for the workers, a few ranges each to even out the load
+inline std::vector<const char *> split_lines(const char *begin,
+                                             const char *end) {
+    return split_lines(begin, end, 4 * num_workers());
+}
+
+/*
+    Concatenates the per-range results into out, copying the ranges on all
+    workers. Returns where every range starts in out (plus the total).
+*/
+template <typename Part, typename T>
+std::vector<uint64_t> concat(const std::vector<Part> &parts,
+                             std::vector<T> &out) {
+    std::vector<uint64_t> offsets(parts.size() + 1, 0);
+    for (size_t i = 0; i < parts.size(); i++)
+        offsets[i + 1] = offsets[i] + parts[i].size();
+    out.resize(offsets.back());
+    parallel_for(parts.size(), 1, [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t i = begin; i < end; i++)
+            std::copy(parts[i].begin(), parts[i].end(),
+                      out.begin() + offsets[i]);
+    });
+    return offsets;
+}
+
+} // namespace text
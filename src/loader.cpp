@@ -0,0 +1,160 @@
+#include <filesystem>
+
+#include "loader.hpp"
+#include "geometry/cluster_lod.hpp"
+#include "io/mesher_format.hpp"
+
+namespace fs = std::filesystem;
+
+MeshLoader::~MeshLoader() {
+    cancel();
+    reap(true);
+}
+
+void MeshLoader::start(const std::string &_filepath) {
+    cancel();
+    filepath = _filepath;
+    progress = std::make_unique<LoadProgress>();
+    mesh = std::make_unique<Mesh>();
+    // the chain is not drawn next to the hierarchy
+    mesh->with_lods = !with_cluster_lod;
+    mesh->with_cluster_lod = with_cluster_lod;
+    mesh->weld_epsilon = weld_epsilon;
+    bvh = std::make_unique<BVH>();
+    worker = std::thread([path = filepath, progress = progress.get(),
+                          mesh = mesh.get(), bvh = bvh.get()] {
+        if (!load_mesh(path, *mesh, *bvh, progress)) {
+            progress->stage = progress->cancelled ? LoadStage::Cancelled
+                                                  : LoadStage::Failed;
+            return;
+        }
+        progress->stage = LoadStage::Done;
+    });
+}
+
+void MeshLoader::cancel() {
+    if (is_busy()) {
+        progress->cancelled = true;
+        abandoned.push_back(Abandoned{std::move(worker), std::move(progress),
+                                      std::move(mesh), std::move(bvh)});
+        progress = std::make_unique<LoadProgress>();
+        progress->stage = LoadStage::Cancelled;
+    }
+    // a finished worker returns right after reporting
+    join();
+    mesh.reset();
+    bvh.reset();
+    reap(false);
+}
+
+void MeshLoader::reap(bool wait) {
+    for (size_t i = 0; i < abandoned.size();) {
+        LoadStage s = abandoned[i].progress->stage;
+        if (!wait && s != LoadStage::Done && s != LoadStage::Failed &&
+            s != LoadStage::Cancelled) {
+            i++;
+            continue;
+        }
+        abandoned[i].worker.join();
+        abandoned.erase(abandoned.begin() + i);
+    }
+}
+
+void MeshLoader::join() {
+    if (worker.joinable())
+        worker.join();
+}
+
+LoadStage MeshLoader::stage() const {
+    return progress ? progress->stage.load() : LoadStage::Done;
+}
+
+bool MeshLoader::is_busy() const {
+    LoadStage s = stage();
+    return s != LoadStage::Done && s != LoadStage::Failed &&
+           s != LoadStage::Cancelled;
+}
+
+bool MeshLoader::poll(Mesh &_mesh, BVH &_bvh) {
+    reap(false);
+    if (!mesh || stage() != LoadStage::Done)
+        return false;
+    join();
+    // the new mesh is drawn the same way as the one it replaces
+    VertexFormat format = _mesh.vertex_format;
+    _mesh = std::move(*mesh);
+    _mesh.vertex_format = format;
+    _mesh.upload();
+    _bvh = std::move(*bvh);
+    // the tree was built against the loader's copy
+    _bvh.mesh = &_mesh;
+    mesh.reset();
+    bvh.reset();
+    return true;
+}
+
+const char *stage_name(LoadStage stage) {
+    switch (stage) {
+    case LoadStage::Queued:
+        return "queued";
+    case LoadStage::Parsing:
+        return "parsing";
+    case LoadStage::Welding:
+        return "welding";
+    case LoadStage::Optimizing:
+        return "reordering";
+    case LoadStage::Processing:
+        return "computing normals";
+    case LoadStage::BuildingLods:
+        return "building levels of detail";
+    case LoadStage::BuildingBVH:
+        return "building BVH";
+    case LoadStage::Done:
+        return "done";
+    case LoadStage::Failed:
+        return "failed";
+    case LoadStage::Cancelled:
+        return "cancelled";
+    }
+    return "";
+}
+
+bool load_mesh(const std::string &filepath, Mesh &mesh, BVH &bvh,
+               LoadProgress *progress) {
+    std::string cache = fs::path(filepath).extension() == ".mesher"
+                            ? filepath
+                            : find_mesher_cache(filepath);
+    if (!cache.empty()) {
+        if (progress)
+            progress->stage = LoadStage::Parsing;
+        if (read_mesher(cache, mesh, &bvh)) {
+            // caches written without the hierarchy
+            if (mesh.with_cluster_lod && mesh.clusters.empty()) {
+                if (progress) {
+                    progress->stage = LoadStage::BuildingLods;
+                    if (progress->cancelled)
+                        return false;
+                }
+                build_cluster_lod(mesh);
+            }
+            return true;
+        }
+        // a stale or broken cache, load the source instead
+        Mesh fresh;
+        fresh.with_lods = mesh.with_lods;
+        fresh.with_cluster_lod = mesh.with_cluster_lod;
+        fresh.weld_epsilon = mesh.weld_epsilon;
+        mesh = std::move(fresh);
+        if (cache == filepath)
+            return false;
+    }
+    if (!mesh.load(filepath, progress))
+        return false;
+    if (progress) {
+        progress->stage = LoadStage::BuildingBVH;
+        if (progress->cancelled)
+            return false;
+    }
+    bvh = BVH(mesh);
+    return true;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mesh.hpp"
+#include "raytracer/bvh.hpp"
+
+/*
+    Loads a mesh and builds its BVH on a background thread so the render
+    loop keeps going; the current mesh stays on screen until poll() swaps in
+    the new one and uploads it on the render thread. Cancelling never waits
+    for the worker: it only notices between stages, so a cancelled load
+    finishes in the background and is cleaned up by a later poll().
+*/
+class MeshLoader {
+  public:
+    MeshLoader() = default;
+    ~MeshLoader();
+
+    MeshLoader(const MeshLoader &) = delete;
+    MeshLoader &operator=(const MeshLoader &) = delete;
+
+    // cancels the load in flight, if any, and starts a new one
+    void start(const std::string &filepath);
+    void cancel();
+
+    bool is_busy() const;
+    LoadStage stage() const;
+    const std::string &get_filepath() const { return filepath; }
+
+    // render thread: when a load has finished, moves the result into mesh
+    // and bvh, uploads the buffers and returns true
+    bool poll(Mesh &mesh, BVH &bvh);
+
+    // build the cluster hierarchy of the meshes loaded from now on
+    bool with_cluster_lod = false;
+    // Mesh::weld_epsilon of the meshes loaded from now on
+    float weld_epsilon = 0.0f;
+
+  private:
+    std::thread worker;
+    std::string filepath;
+    // owned by the worker until it reports Done
+    std::unique_ptr<LoadProgress> progress;
+    std::unique_ptr<Mesh> mesh;
+    std::unique_ptr<BVH> bvh;
+
+    // cancelled loads still running, with everything their worker uses
+    struct Abandoned {
+        std::thread worker;
+        std::unique_ptr<LoadProgress> progress;
+        std::unique_ptr<Mesh> mesh;
+        std::unique_ptr<BVH> bvh;
+    };
+    std::vector<Abandoned> abandoned;
+
+    void join();
+    // joins the abandoned workers that are done, or all of them with wait
+    void reap(bool wait);
+};
+
+const char *stage_name(LoadStage stage);
+
+// loads filepath, or its .mesher cache when there is a fresh one, and
+// builds the BVH unless the cache had it; no OpenGL calls
+bool load_mesh(const std::string &filepath, Mesh &mesh, BVH &bvh,
+               LoadProgress *progress = nullptr);
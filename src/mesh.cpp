@@ -1,11 +1,39 @@
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
 #include <iostream>
 
 #include "mesh.hpp"
+#include "geometry/cluster_lod.hpp"
+#include "geometry/meshlets.hpp"
+#include "geometry/normals.hpp"
+#include "geometry/octahedral.hpp"
+#include "geometry/overdraw.hpp"
+#include "geometry/simplify.hpp"
+#include "geometry/vertex_cache.hpp"
+#include "geometry/weld.hpp"
+#include "io/compressed_format.hpp"
+#include "io/mapped_file.hpp"
+#include "io/mesher_format.hpp"
+#include "io/obj.hpp"
+#include "io/ply.hpp"
+#include "io/stl.hpp"
+#include "parallel.hpp"
+
+namespace fs = std::filesystem;
+
+// largest multiple of 3 that fits the GLsizei count of one draw call
+constexpr uint64_t MAX_DRAW_INDICES = 3 * (INT32_MAX / 3);
+// screen space error in pixels a level of detail may show
+constexpr float LOD_PIXEL_ERROR = 1.0f;
+// a coarser level is only taken once its error is this far below the
+// limit, so a camera resting near a switch distance does not flicker
+constexpr float LOD_HYSTERESIS = 0.75f;
 
 Mesh Mesh::highlight_triangle(uint32_t tri_idx) {
     Triangle &tri = triangles[tri_idx];
     glm::vec4 color{1.0f, 0.0f, 0.0f, 1.0f};
-    std::vector<Mesh::Vertex> vertices;
+    std::vector<glm::vec3> positions, normals;
     auto [v1, v2, v3] = get_triangle_vertices(tri); 
     // glm::vec3 normal = glm::normalize(glm::cross(v2-v1, v3-v1)); 
     glm::vec3 normal = glm::cross(v2-v1, v3-v1); 
@@ -16,10 +44,11 @@ Mesh Mesh::highlight_triangle(uint32_t tri_idx) {
         // if(x < 0)
         //     normal = -1.0f * normal;
         glm::vec3 vv = v + normal * 0.5f;
-        vertices.push_back(Mesh::Vertex{vv, color, normal});
+        positions.push_back(vv);
+        normals.push_back(normal);
     }
     std::vector<GLuint> indices{0, 2, 1};
-    return Mesh(vertices, indices);
+    return Mesh(positions, std::vector<glm::vec4>(3, color), normals, indices);
 }
 
 // depth -> x | width -> y |  height -> z
@@ -37,96 +66,127 @@ Mesh Mesh::construct_bounding_box() {
                                 4, 7, 5, 4, 6, 7, 6, 2, 3, 6, 3, 7,
                                 6, 4, 2, 2, 4, 0, 3, 7, 1, 1, 7, 5};
 
-    std::vector<Mesh::Vertex> vertices;
+    std::vector<glm::vec3> positions;
     for (uint32_t i = 0; i < vertices_.size(); i += 3) {
-        vertices.push_back(Mesh::Vertex{
-            glm::vec3(vertices_[i + 0], vertices_[i + 1], vertices_[i + 2]),
-            glm::vec4(1.0f, 0.0f, 0.0f, 0.3f),
-            glm::vec3(1.0f),
-        });
+        positions.push_back(
+            glm::vec3(vertices_[i + 0], vertices_[i + 1], vertices_[i + 2]));
     }
     glm::vec3 vec = glm::abs(box.max - box.min) * 0.5f;
-    for (uint32_t i = 0; i < vertices.size(); i++) {
-        // vertices[i].position = vertices[i].position + 1.5f * center;
-        vertices[i].position = vertices[i].position * vec;
+    for (uint32_t i = 0; i < positions.size(); i++) {
+        // positions[i] = positions[i] + 1.5f * center;
+        positions[i] = positions[i] * vec;
     }
     // box_mesh = box_mesh.scale(glm::abs(box.max-box.min));
     // box_mesh.rotate(-45, glm::vec3(1.0f, 0.0f, 0.0f));
-    Mesh box_mesh(vertices, indices);
+    Mesh box_mesh(positions,
+                  std::vector<glm::vec4>(positions.size(),
+                                         glm::vec4(1.0f, 0.0f, 0.0f, 0.3f)),
+                  std::vector<glm::vec3>(positions.size(), glm::vec3(1.0f)),
+                  indices);
     return box_mesh;
 }
 
-static void process_mesh(aiMesh *mesh, Mesh &mymesh) {
-    mymesh.vertices.reserve(mesh->mNumVertices + 1);
+static void process_mesh(aiMesh *mesh, const aiMatrix4x4 &transform,
+                         Mesh &mymesh) {
+    const uint64_t base = mymesh.vertex_count();
+    mymesh.resize_vertices(base + mesh->mNumVertices);
     for (uint32_t i = 0; i < mesh->mNumVertices; i++) {
-        const auto vec = mesh->mVertices[i];
-
-        mymesh.bounding_box.max.x = glm::max(vec.x, mymesh.bounding_box.max.x);
-        mymesh.bounding_box.max.y = glm::max(vec.y, mymesh.bounding_box.max.y);
-        mymesh.bounding_box.max.z = glm::max(vec.z, mymesh.bounding_box.max.z);
-
-        mymesh.bounding_box.min.x = glm::min(vec.x, mymesh.bounding_box.min.x);
-        mymesh.bounding_box.min.y = glm::min(vec.y, mymesh.bounding_box.min.y);
-        mymesh.bounding_box.min.z = glm::min(vec.z, mymesh.bounding_box.min.z);
-
-        Mesh::Vertex vertex{
-            glm::vec3(vec.x, vec.y, vec.z),          // position
-            glm::vec4(0.753f, 0.753f, 0.753f, 1.0f), // color
-            glm::vec3(0.0f),                         // normal
-        };
-        mymesh.center += vertex.position;
-
-        mymesh.vertices.push_back(vertex);
+        const aiVector3D vec = transform * mesh->mVertices[i];
+        mymesh.positions[base + i] = glm::vec3(vec.x, vec.y, vec.z);
     }
-    mymesh.center /= (float)mymesh.vertices.size();
 
-    mymesh.faces.reserve(mesh->mNumFaces * 3 + 1);
     for (uint32_t i = 0; i < mesh->mNumFaces; i++) {
-        aiFace face = mesh->mFaces[i];
-        assert(face.mNumIndices == 3);
-        mymesh.faces.push_back(face.mIndices[0]);
-        mymesh.faces.push_back(face.mIndices[1]);
-        mymesh.faces.push_back(face.mIndices[2]);
-
-        // std::cout << face.mIndices[0] << " "
-        //           << face.mIndices[1] << " "
-        //           << face.mIndices[2] << " "
-        //           << std::endl;
+        const aiFace &face = mesh->mFaces[i];
+        // points and lines left over after triangulation
+        if (face.mNumIndices != 3)
+            continue;
+        mymesh.faces.push_back(base + face.mIndices[0]);
+        mymesh.faces.push_back(base + face.mIndices[1]);
+        mymesh.faces.push_back(base + face.mIndices[2]);
     }
+}
 
-    uint32_t idx = 0;
-    // calculating vertex normals
-    glm::vec3 A, B, C, normal;
-    for (uint32_t i = 0; i < mymesh.faces.size(); i += 3) {
-        A = mymesh.vertices[mymesh.faces[i + 0]].position;
-        B = mymesh.vertices[mymesh.faces[i + 1]].position;
-        C = mymesh.vertices[mymesh.faces[i + 2]].position;
-        normal = glm::cross(B - A, C - A);
-
-        glm::vec3 centroid = 0.3333f * (A + B + C);
-        mymesh.triangles.push_back(Triangle{idx++, mymesh.faces[i], centroid});
-
-        mymesh.vertices[mymesh.faces[i + 0]].normal += normal;
-        mymesh.vertices[mymesh.faces[i + 1]].normal += normal;
-        mymesh.vertices[mymesh.faces[i + 2]].normal += normal;
+/*
+    Walks the whole node tree and appends every mesh it references, moved
+    into the root's space by the product of the transforms down to its node.
+    All meshes end up in the one vertex/index buffer, each remembered as a
+    part by its index range. A mesh instanced by several nodes is copied
+    once per node.
+*/
+// vertices and face indices the whole tree adds, to size the buffers once
+static void count_node(aiNode *node, const aiScene *scene, uint64_t &vertices,
+                       uint64_t &indices) {
+    for (uint32_t i = 0; i < node->mNumMeshes; i++) {
+        vertices += scene->mMeshes[node->mMeshes[i]]->mNumVertices;
+        indices += 3ull * scene->mMeshes[node->mMeshes[i]]->mNumFaces;
     }
+    for (uint32_t i = 0; i < node->mNumChildren; i++)
+        count_node(node->mChildren[i], scene, vertices, indices);
 }
 
-static void process_node(aiNode *node, const aiScene *scene, Mesh &mymesh) {
-    // TODO: working with one mesh for now
-    aiNode *child = node->mChildren[0];
-    uint32_t index = child->mMeshes[0];
-    aiMesh *mesh = scene->mMeshes[index];
-    process_mesh(mesh, mymesh);
+static void process_node(aiNode *node, const aiScene *scene,
+                         const aiMatrix4x4 &parent, Mesh &mymesh) {
+    const aiMatrix4x4 transform = parent * node->mTransformation;
+    for (uint32_t i = 0; i < node->mNumMeshes; i++) {
+        uint64_t first_index = mymesh.faces.size();
+        process_mesh(scene->mMeshes[node->mMeshes[i]], transform, mymesh);
+        uint64_t index_count = mymesh.faces.size() - first_index;
+        if (index_count > 0)
+            mymesh.parts.push_back(
+                MeshPart{node->mName.C_Str(), first_index, index_count});
+    }
+    for (uint32_t i = 0; i < node->mNumChildren; i++)
+        process_node(node->mChildren[i], scene, transform, mymesh);
 }
 
-Mesh::Mesh(std::vector<Vertex> _vertices, std::vector<GLuint> _faces) {
-    vertices = _vertices;
-    faces = _faces;
-    setup_mesh();
+// bounding box, center, triangles and vertex normals from vertices and faces,
+// files that store their own normals skip the last step
+static void process_geometry(Mesh &mymesh, bool with_normals = true) {
+    // per worker partial box and position sums, merged below
+    std::vector<AABB> boxes(num_workers());
+    std::vector<glm::vec3> sums(num_workers(), glm::vec3(0.0f));
+    parallel_for(mymesh.vertex_count(), 1 << 16,
+                 [&](uint64_t begin, uint64_t end, uint32_t worker) {
+                     AABB &box = boxes[worker];
+                     glm::vec3 &sum = sums[worker];
+                     for (uint64_t i = begin; i < end; i++) {
+                         const glm::vec3 &vec = mymesh.positions[i];
+                         box.max = glm::max(vec, box.max);
+                         box.min = glm::min(vec, box.min);
+                         sum += vec;
+                     }
+                 });
+    mymesh.bounding_box = AABB();
+    mymesh.center = glm::vec3(0.0f);
+    for (uint32_t i = 0; i < boxes.size(); i++) {
+        mymesh.bounding_box.max = glm::max(boxes[i].max, mymesh.bounding_box.max);
+        mymesh.bounding_box.min = glm::min(boxes[i].min, mymesh.bounding_box.min);
+        mymesh.center += sums[i];
+    }
+    mymesh.center /= (float)mymesh.vertex_count();
+
+    mymesh.triangles.resize(mymesh.faces.size() / 3);
+    parallel_for(mymesh.triangles.size(), 1 << 16,
+                 [&](uint64_t begin, uint64_t end, uint32_t) {
+                     for (uint64_t i = begin; i < end; i++) {
+                         const glm::vec3 &A =
+                             mymesh.positions[mymesh.faces[3 * i + 0]];
+                         const glm::vec3 &B =
+                             mymesh.positions[mymesh.faces[3 * i + 1]];
+                         const glm::vec3 &C =
+                             mymesh.positions[mymesh.faces[3 * i + 2]];
+                         glm::vec3 centroid = 0.3333f * (A + B + C);
+                         mymesh.triangles[i] =
+                             Triangle{(uint32_t)i, centroid};
+                     }
+                 });
+
+    if (!with_normals)
+        return;
+    mymesh.refresh_normals(true);
 }
 
-Mesh::Mesh(std::string filepath) {
+static bool import_assimp(const std::string &filepath, Mesh &mymesh) {
     Assimp::Importer importer;
     const aiScene *scene =
         importer.ReadFile(filepath, aiProcess_Triangulate | aiProcess_FlipUVs);
@@ -134,10 +194,195 @@ Mesh::Mesh(std::string filepath) {
         !scene->mRootNode) {
         std::cerr << "ERROR::ASSIMP::" << importer.GetErrorString()
                   << std::endl;
-        return;
+        return false;
+    }
+    uint64_t vertex_count = 0, index_count = 0;
+    count_node(scene->mRootNode, scene, vertex_count, index_count);
+    mymesh.positions.reserve(vertex_count);
+    mymesh.normals.reserve(vertex_count);
+    mymesh.colors.reserve(vertex_count);
+    mymesh.faces.reserve(index_count);
+    process_node(scene->mRootNode, scene, aiMatrix4x4(), mymesh);
+    if (mymesh.faces.empty()) {
+        std::cerr << "ERROR::ASSIMP::NO_TRIANGLES::" << filepath << std::endl;
+        return false;
     }
-    process_node(scene->mRootNode, scene, *this);
+    return true;
+}
+
+static bool import_native_file(const std::string &filepath, Mesh &mymesh,
+                               ScratchArenas &scratch) {
+    std::string ext = fs::path(filepath).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    if (ext != ".stl" && ext != ".obj" && ext != ".ply")
+        return false;
+    MappedFile file(filepath);
+    if (!file.is_open())
+        return false;
+    if (ext == ".obj")
+        return load_obj(file, mymesh, scratch);
+    if (ext == ".ply")
+        return load_ply(file, mymesh, scratch);
+    if (is_binary_stl(file))
+        return load_binary_stl(file, mymesh);
+    return load_ascii_stl(file, mymesh, scratch);
+}
+
+// formats read without Assimp, false to fall back to it
+static bool import_native(const std::string &filepath, Mesh &mymesh,
+                          ScratchArenas &scratch) {
+    bool ok = import_native_file(filepath, mymesh, scratch);
+    // the parse results are in mymesh now
+    scratch.release();
+    if (ok)
+        return true;
+    mymesh.resize_vertices(0);
+    mymesh.faces.clear();
+    mymesh.parts.clear();
+    return false;
+}
+
+Mesh::Mesh(std::vector<glm::vec3> _positions, std::vector<glm::vec4> _colors,
+           std::vector<glm::vec3> _normals, std::vector<GLuint> _faces) {
+    positions = std::move(_positions);
+    colors = std::move(_colors);
+    normals = std::move(_normals);
+    faces = std::move(_faces);
     setup_mesh();
+}
+
+Mesh::Mesh(std::string filepath) {
+    if (load(filepath))
+        upload();
+}
+
+static bool is_cancelled(LoadProgress *progress, LoadStage next) {
+    if (!progress)
+        return false;
+    progress->stage = next;
+    return progress->cancelled;
+}
+
+// levels of detail and the cluster hierarchy; errors are relative to the
+// bounding box, so it has to be there
+static bool build_levels(Mesh &mymesh, LoadProgress *progress) {
+    if (!mymesh.with_lods && !mymesh.with_cluster_lod)
+        return true;
+    if (is_cancelled(progress, LoadStage::BuildingLods))
+        return false;
+    if (mymesh.with_lods)
+        build_lods(mymesh);
+    if (mymesh.with_cluster_lod)
+        build_cluster_lod(mymesh);
+    return true;
+}
+
+// formats without a scene graph are one part named after the file
+static void add_single_part(const std::string &filepath, Mesh &mymesh) {
+    if (mymesh.parts.empty())
+        mymesh.parts.push_back(MeshPart{fs::path(filepath).stem().string(), 0,
+                                        mymesh.faces.size()});
+}
+
+bool Mesh::load(const std::string &filepath, LoadProgress *progress) {
+    if (is_cancelled(progress, LoadStage::Parsing))
+        return false;
+    // already processed, nothing left to compute
+    if (fs::path(filepath).extension() == ".mesher")
+        return read_mesher(filepath, *this, nullptr);
+    // compressed files carry quantized normals, only the rest is rebuilt
+    if (fs::path(filepath).extension() == ".meshz") {
+        if (!read_meshz(filepath, *this))
+            return false;
+        add_single_part(filepath, *this);
+        if (is_cancelled(progress, LoadStage::Processing))
+            return false;
+        process_geometry(*this, false);
+        if (with_meshlets)
+            build_meshlets(*this);
+        if (!build_levels(*this, progress))
+            return false;
+        reset_model_matrix();
+        return true;
+    }
+    // scratch of every stage below, emptied at the end of each one
+    ScratchArenas scratch;
+    if (!import_native(filepath, *this, scratch) &&
+        !import_assimp(filepath, *this))
+        return false;
+    if (faces.size() / 3 > UINT32_MAX) {
+        std::cerr << "ERROR::MESH::TOO_MANY_TRIANGLES::" << filepath
+                  << ", split it with --chunk" << std::endl;
+        return false;
+    }
+    add_single_part(filepath, *this);
+    // STL has no shared vertices, without welding the normals of
+    // neighbouring faces never get averaged
+    if (is_cancelled(progress, LoadStage::Welding))
+        return false;
+    if (is_unindexed(*this) || weld_epsilon > 0.0f) {
+        weld_vertices(*this, weld_epsilon, scratch);
+        scratch.release();
+    }
+    if (!parts_cover_faces()) {
+        std::cerr << "ERROR::MESH::BAD_PARTS::" << filepath << std::endl;
+        return false;
+    }
+    // before the triangles are built, so they come out in draw order
+    if (is_cancelled(progress, LoadStage::Optimizing))
+        return false;
+    if (reorder) {
+        optimize_vertex_cache(*this);
+        optimize_overdraw(*this);
+        optimize_vertex_fetch(*this);
+    }
+    if (is_cancelled(progress, LoadStage::Processing))
+        return false;
+    process_geometry(*this);
+    // in the final triangle order
+    if (with_meshlets)
+        build_meshlets(*this);
+    if (!build_levels(*this, progress))
+        return false;
+    reset_model_matrix();
+    return true;
+}
+
+void Mesh::upload() { setup_mesh(); }
+
+void Mesh::resize_vertices(uint64_t count) {
+    positions.resize(count);
+    normals.resize(count, glm::vec3(0.0f));
+    colors.resize(count, DEFAULT_COLOR);
+}
+
+uint32_t Mesh::find_part(uint64_t tri_idx) const {
+    // first part starting after the triangle, the one before owns it
+    auto it = std::upper_bound(parts.begin(), parts.end(), 3 * tri_idx,
+                               [](uint64_t index, const MeshPart &part) {
+                                   return index < part.first_index;
+                               });
+    return it == parts.begin() ? 0 : (uint32_t)(it - parts.begin() - 1);
+}
+
+void Mesh::refresh_normals(bool faces_changed) {
+    if (faces_changed)
+        normal_builder.rebuild(*this);
+    normal_builder.update(*this);
+}
+
+bool Mesh::parts_cover_faces() const {
+    uint64_t next = 0;
+    for (const MeshPart &part : parts) {
+        if (part.first_index != next || part.index_count % 3 != 0)
+            return false;
+        next += part.index_count;
+    }
+    return next == faces.size();
+}
+
+void Mesh::reset_model_matrix() {
+    model_matrix = glm::mat4(1.0f);
     // center mesh
     glm::vec3 vec = glm::abs(bounding_box.max - bounding_box.min);
     auto ratio = 1.45f / glm::max(vec.x, vec.y, vec.z);
@@ -148,76 +393,294 @@ Mesh::Mesh(std::string filepath) {
     center *= ratio;
 }
 
+std::vector<Mesh::Vertex> Mesh::interleave_vertices() const {
+    std::vector<Vertex> interleaved(vertex_count());
+    parallel_for(interleaved.size(), 1 << 16,
+                 [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t i = begin; i < end; i++)
+            interleaved[i] = Vertex{positions[i], colors[i], normals[i]};
+    });
+    return interleaved;
+}
+
+/*
+    Positions become 16 bit offsets on the bounding box grid and are scaled
+    back by `dequantize` in the vertex shader, normals are octahedral and
+    colors RGBA8. 12 instead of 40 bytes per vertex, picking and all other
+    CPU work keep using the float vertices.
+*/
+std::vector<PackedVertex> Mesh::pack_vertices() {
+    glm::vec3 extent = bounding_box.max - bounding_box.min;
+    for (int i = 0; i < 3; i++)
+        extent[i] = extent[i] > 0.0f ? extent[i] : 1.0f;
+    dequantize = glm::scale(glm::translate(glm::mat4(1.0f), bounding_box.min),
+                            extent);
+    const glm::vec3 to_grid = 65535.0f / extent;
+
+    std::vector<PackedVertex> packed(vertex_count());
+    parallel_for(packed.size(), 1 << 16,
+                 [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t i = begin; i < end; i++) {
+            PackedVertex &p = packed[i];
+            glm::vec3 q = glm::clamp((positions[i] - bounding_box.min) * to_grid,
+                                     0.0f, 65535.0f);
+            glm::vec2 n = glm::clamp(octahedral_encode(normals[i]), -1.0f, 1.0f);
+            glm::vec4 c = glm::clamp(colors[i], 0.0f, 1.0f) * 255.0f;
+            for (int k = 0; k < 3; k++)
+                p.position[k] = (uint16_t)(q[k] + 0.5f);
+            for (int k = 0; k < 2; k++)
+                p.normal[k] = (int8_t)std::round(n[k] * 127.0f);
+            for (int k = 0; k < 4; k++)
+                p.color[k] = (uint8_t)(c[k] + 0.5f);
+        }
+    });
+    return packed;
+}
+
 void Mesh::setup_mesh() {
 
+    // uploading again replaces the old buffers instead of leaking them
+    gpu.create();
+
     // setup vertex array object
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
+    glBindVertexArray(gpu.get_vao());
 
     // setup vertex buffer object
-    glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vertices.size(),
-                 vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, gpu.get_vbo());
+    // packing needs the bounding box, meshes built in code may not have one
+    if (bounding_box.min.x > bounding_box.max.x)
+        vertex_format = VertexFormat::Float;
+    if (vertex_format == VertexFormat::Packed) {
+        std::vector<PackedVertex> packed = pack_vertices();
+        glBufferData(GL_ARRAY_BUFFER, sizeof(PackedVertex) * packed.size(),
+                     packed.data(), GL_STATIC_DRAW);
+
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE,
+                              sizeof(PackedVertex),
+                              (void *)offsetof(PackedVertex, position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+                              sizeof(PackedVertex),
+                              (GLvoid *)offsetof(PackedVertex, color));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_BYTE, GL_TRUE, sizeof(PackedVertex),
+                              (GLvoid *)offsetof(PackedVertex, normal));
+    } else {
+        dequantize = glm::mat4(1.0f);
+        std::vector<Vertex> interleaved = interleave_vertices();
+        glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * interleaved.size(),
+                     interleaved.data(), GL_STATIC_DRAW);
+
+        // specify the structure within VAO
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                              (void *)offsetof(Vertex, position));
+
+        // colors
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                              (GLvoid *)offsetof(Vertex, color));
+
+        // normals
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 3, GL_FLOAT, GL_TRUE, sizeof(Vertex),
+                              (GLvoid *)offsetof(Vertex, normal));
+    }
+
+    upload_indices();
+}
+
+/*
+    Meshes (or chunks) with at most 65536 vertices get 16 bit indices, half
+    the index memory and bandwidth of 32 bit ones. Larger meshes keep 32 bit
+    indices; there is no 64 bit path, a mesh past that is split into chunks
+    that each stay within 32 bits.
+*/
+void Mesh::upload_indices() {
+    // the cluster hierarchy and the levels of detail follow faces in the
+    // same buffer
+    const std::vector<GLuint> *sources[] = {&faces, &cluster_faces,
+                                            &lod_faces};
+    uint64_t count = 0;
+    for (const std::vector<GLuint> *source : sources)
+        count += source->size();
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpu.get_ebo());
+    if (vertex_count() > (1 << 16)) {
+        index_type = GL_UNSIGNED_INT;
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * count, nullptr,
+                     GL_STATIC_DRAW);
+        uint64_t offset = 0;
+        for (const std::vector<GLuint> *source : sources) {
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * offset,
+                            sizeof(GLuint) * source->size(), source->data());
+            offset += source->size();
+        }
+        return;
+    }
+    index_type = GL_UNSIGNED_SHORT;
+    std::vector<uint16_t> narrow(count);
+    uint64_t offset = 0;
+    for (const std::vector<GLuint> *source : sources) {
+        parallel_for(source->size(), 1 << 16,
+                     [&](uint64_t begin, uint64_t end, uint32_t) {
+            for (uint64_t i = begin; i < end; i++)
+                narrow[offset + i] = (uint16_t)(*source)[i];
+        });
+        offset += source->size();
+    }
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint16_t) * narrow.size(),
+                 narrow.data(), GL_STATIC_DRAW);
+}
 
-    // specify the structure within VAO
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                          (void *)offsetof(Vertex, position));
+void Mesh::draw(Shader &shader) {
+    // nothing loaded yet
+    if (!gpu.is_valid())
+        return;
+    shader.set_uniform("u_Dequantize", dequantize);
+    shader.set_uniform("u_OctahedralNormals",
+                       vertex_format == VertexFormat::Packed);
+    glBindVertexArray(gpu.get_vao());
+    glBindBuffer(GL_ARRAY_BUFFER, gpu.get_vbo());
+    // the count is a GLsizei, bigger index buffers are drawn in batches
+    const uint64_t batch = MAX_DRAW_INDICES;
+    const uint64_t index_size =
+        index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(GLuint);
+    if (lod == 0 && culled) {
+        glMultiDrawElements(GL_TRIANGLES, draw_counts.data(), index_type,
+                            draw_offsets.data(), (GLsizei)draw_counts.size());
+        return;
+    }
+    uint64_t begin = 0, end = faces.size();
+    if (lod > 0 && lod <= lods.size()) {
+        begin = faces.size() + cluster_faces.size() +
+                lods[lod - 1].first_index;
+        end = begin + lods[lod - 1].index_count;
+    }
+    for (uint64_t first = begin; first < end; first += batch) {
+        uint64_t count = std::min<uint64_t>(batch, end - first);
+        glDrawElements(GL_TRIANGLES, (GLsizei)count, index_type,
+                       (void *)(first * index_size));
+    }
+}
 
-    // colors
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                          (GLvoid *)offsetof(Vertex, color));
+void Mesh::cull_meshlets(const glm::mat4 &view_model, const glm::mat4 &proj,
+                         bool cull_backfaces) {
+    culled = !meshlets.empty();
+    if (culled)
+        set_draw_ranges(
+            visible_meshlets(*this, view_model, proj, cull_backfaces));
+}
 
-    // normals
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_TRUE, sizeof(Vertex),
-                          (GLvoid *)offsetof(Vertex, normal));
+void Mesh::cull_clusters(const glm::mat4 &view_model, const glm::mat4 &proj,
+                         float viewport_height) {
+    culled = !clusters.empty();
+    if (!culled)
+        return;
+    lod = 0;
+    set_draw_ranges(
+        visible_clusters(*this, view_model, proj, viewport_height));
+}
 
-    // setup element buffer object
-    glGenBuffers(1, &EBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * faces.size(),
-                 faces.data(), GL_STATIC_DRAW);
+void Mesh::set_draw_ranges(
+    const std::vector<std::pair<uint64_t, uint64_t>> &ranges) {
+    draw_counts.clear();
+    draw_offsets.clear();
+    const uint64_t index_size =
+        index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(GLuint);
+    for (auto [first, count] : ranges) {
+        // merged ranges can outgrow one GLsizei count
+        for (uint64_t i = 0; i < count; i += MAX_DRAW_INDICES) {
+            draw_counts.push_back(
+                (GLsizei)std::min<uint64_t>(MAX_DRAW_INDICES, count - i));
+            draw_offsets.push_back((const void *)((first + i) * index_size));
+        }
+    }
 }
 
-void Mesh::draw(Shader &shader) {
-    (void)shader;
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glDrawElements(GL_TRIANGLES, faces.size(), GL_UNSIGNED_INT, 0);
+/*
+    A level's error in pixels is its relative error times the projected
+    size of the bounding box's longest side, taken at the box's point
+    nearest to the camera. The coarsest level within LOD_PIXEL_ERROR is
+    drawn; moving to a coarser level also needs it to stay within
+    LOD_HYSTERESIS of that, moving to a finer one happens at once.
+*/
+void Mesh::select_lod(const glm::mat4 &view_model, const glm::mat4 &proj,
+                      float viewport_height) {
+    if (lods.empty() || bounding_box.min.x > bounding_box.max.x) {
+        lod = 0;
+        return;
+    }
+    glm::vec3 eye = glm::vec3(glm::inverse(view_model) *
+                              glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    float distance = glm::length(
+        eye - glm::clamp(eye, bounding_box.min, bounding_box.max));
+    glm::vec3 size = bounding_box.max - bounding_box.min;
+    float longest = glm::max(glm::max(size.x, size.y), size.z);
+    // proj[1][1] is 1 / tan(fovy / 2); the scale of the model matrix is
+    // in both the size and the distance and cancels out
+    float projected = distance > 0.0f
+                          ? longest * proj[1][1] * 0.5f * viewport_height /
+                                distance
+                          : INFINITY;
+    auto coarsest = [&](float limit) {
+        uint32_t level = 0;
+        for (uint32_t i = 1; i <= lods.size(); i++)
+            if (lods[i - 1].error * projected <= limit)
+                level = i;
+        return level;
+    };
+    uint32_t fits = coarsest(LOD_PIXEL_ERROR);
+    if (fits < lod)
+        lod = fits;
+    else
+        lod = std::max(lod, coarsest(LOD_PIXEL_ERROR * LOD_HYSTERESIS));
+    lod = std::min<uint32_t>(lod, lods.size());
+}
+
+void Mesh::update_vertices() {
+    if (!gpu.is_valid())
+        return;
+    glBindBuffer(GL_ARRAY_BUFFER, gpu.get_vbo());
+    if (vertex_format == VertexFormat::Packed) {
+        std::vector<PackedVertex> packed = pack_vertices();
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(PackedVertex) * packed.size(),
+                        packed.data());
+        return;
+    }
+    std::vector<Vertex> interleaved = interleave_vertices();
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Vertex) * interleaved.size(),
+                    interleaved.data());
 }
 
-Mesh Mesh::scale(float s) {
+Mesh &Mesh::scale(float s) {
     model_matrix = glm::scale(model_matrix, glm::vec3(s));
     return *this;
 }
 
-Mesh Mesh::scale(glm::vec3 s) {
+Mesh &Mesh::scale(glm::vec3 s) {
     model_matrix = glm::scale(model_matrix, s);
     return *this;
 }
 
-Mesh Mesh::translate(float t) {
+Mesh &Mesh::translate(float t) {
     model_matrix = glm::translate(model_matrix, glm::vec3(t));
     return *this;
 }
 
-Mesh Mesh::translate(glm::vec3 t) {
+Mesh &Mesh::translate(glm::vec3 t) {
     model_matrix = glm::translate(model_matrix, t);
     return *this;
 }
 
-Mesh Mesh::rotate(float angle, glm::vec3 axis) {
+Mesh &Mesh::rotate(float angle, glm::vec3 axis) {
     model_matrix = glm::rotate(model_matrix, glm::radians(angle), axis);
     return *this;
 }
 
 glm::mat4 Mesh::get_model_matrix() { return model_matrix; }
 
-std::array<glm::vec3, 3> Mesh::get_triangle_vertices(Triangle &tri) const {
-    uint32_t v1_idx = tri.first_vertex_idx;
-    return {vertices[v1_idx + 0].position, vertices[v1_idx + 1].position,
-            vertices[v1_idx + 2].position};
+std::array<glm::vec3, 3> Mesh::get_triangle_vertices(const Triangle &tri) const {
+    const GLuint *face = &faces[3 * tri.id];
+    return {positions[face[0]], positions[face[1]], positions[face[2]]};
 }
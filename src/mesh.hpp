@@ -1,6 +1,9 @@
 #pragma once
 
 #include <array>
+#include <atomic>
+#include <string>
+#include <utility>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/extended_min_max.hpp>
 #include <glm/mat4x4.hpp>
@@ -13,8 +16,13 @@
 #include <assimp/scene.h>
 
 #include "../include/glad.h"
+#include "./geometry/normals.hpp"
+#include "./renderer/gpu_mesh.hpp"
 #include "./renderer/shader.hpp"
 
+// color of freshly loaded meshes
+const glm::vec4 DEFAULT_COLOR{0.753f, 0.753f, 0.753f, 1.0f};
+
 // axis-aligned bounding box
 struct AABB {
     glm::vec3 max{-1e30f};
@@ -22,14 +30,110 @@ struct AABB {
 };
 
 struct Triangle {
-    // index to Vertex in vertices
-    uint64_t id;
-    uint64_t first_vertex_idx;
+    // the triangle's vertex indices are faces[3 * id + 0..2]; meshes past
+    // 4G triangles have to be split with --chunk
+    uint32_t id;
     glm::vec3 centroid;
 };
 
+// one mesh of a multi-part file, all parts share the mesh buffers
+struct MeshPart {
+    std::string name;
+    // the part's triangles are faces[first_index, first_index + index_count)
+    uint64_t first_index;
+    uint64_t index_count;
+};
+
+// coarser version of the whole mesh over the same vertices, drawn when the
+// mesh is small on screen
+struct MeshLod {
+    // the level's triangles are lod_faces[first_index, first_index +
+    // index_count)
+    uint64_t first_index;
+    uint64_t index_count;
+    // largest distance to the full mesh, as a fraction of the longest side
+    // of the bounding box
+    float error;
+};
+
+// small cluster of neighbouring triangles, the unit of culling
+struct Meshlet {
+    // the meshlet's triangles are faces[first_index, first_index +
+    // index_count)
+    uint64_t first_index;
+    uint32_t index_count;
+    uint32_t vertex_count;
+    // bounding sphere
+    glm::vec3 center;
+    float radius;
+    // every triangle faces away from eyes with
+    // dot(center - eye, cone_axis) >= cone_cutoff * |center - eye| + radius
+    glm::vec3 cone_axis;
+    float cone_cutoff;
+};
+
+// node of the cluster LOD hierarchy, see build_cluster_lod()
+struct Cluster {
+    // the cluster's triangles are [first_index, first_index + index_count)
+    // of faces followed by cluster_faces
+    uint64_t first_index;
+    uint32_t index_count;
+    // 0 for the clusters of faces
+    uint32_t level;
+    // bounds and error, in mesh units, of the group the cluster was
+    // simplified in, the same for every cluster made from that group
+    glm::vec3 center;
+    float radius;
+    float error;
+    // the same for the group the cluster was simplified into, shared by
+    // every cluster of that group; infinite error for the roots
+    glm::vec3 parent_center;
+    float parent_radius;
+    float parent_error;
+};
+
+// layout of the vertex buffer on the GPU
+enum class VertexFormat {
+    // Mesh::Vertex as is, 40 bytes
+    Float,
+    // PackedVertex, 12 bytes, decoded in the vertex shader
+    Packed,
+};
+
+struct PackedVertex {
+    // position inside the bounding box, 0..65535 per axis
+    uint16_t position[3];
+    // octahedral normal as snorm8
+    int8_t normal[2];
+    // RGBA8
+    uint8_t color[4];
+};
+
+// steps of Mesh::load, in order
+enum class LoadStage : uint32_t {
+    Queued,
+    Parsing,
+    Welding,
+    Optimizing,
+    Processing,
+    BuildingLods,
+    BuildingBVH,
+    Done,
+    Failed,
+    Cancelled,
+};
+
+// shared between a loading thread and the render thread
+struct LoadProgress {
+    std::atomic<LoadStage> stage{LoadStage::Queued};
+    // checked between the stages, the load gives up at the next one
+    std::atomic<bool> cancelled{false};
+};
+
 class Mesh {
   public:
+    // interleaved layout of the VBO for VertexFormat::Float, only built
+    // for the upload
     struct Vertex {
         glm::vec3 position;
         glm::vec4 color;
@@ -38,33 +142,125 @@ class Mesh {
 
     glm::vec3 center;
     std::vector<Triangle> triangles;
-    std::vector<Vertex> vertices;
+    // vertex attributes in separate arrays, all vertex_count() long, so CPU
+    // passes only stream the ones they read
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec4> colors;
     std::vector<GLuint> faces;
     // initialize with identity
     glm::mat4 model_matrix{1.0f};
     AABB bounding_box;
+    // index ranges of the meshes the file was made of, in file order
+    std::vector<MeshPart> parts;
+    // picked before upload(), the CPU side always keeps full precision
+    VertexFormat vertex_format = VertexFormat::Float;
+    // load() reorders triangles and vertices for the GPU caches and less
+    // overdraw, off keeps the file order
+    bool reorder = true;
+    // load() welds triangle soups on exact positions; above 0 every mesh is
+    // welded on vertices closer than this (mesh units), which closes the
+    // hairline cracks of scans and exports
+    float weld_epsilon = 0.0f;
+    // levels of detail, finest first, built by load() unless with_lods is
+    // off; index buffers of all levels one after the other in lod_faces
+    std::vector<MeshLod> lods;
+    std::vector<GLuint> lod_faces;
+    bool with_lods = true;
+    // faces cut into meshlets by load() unless with_meshlets is off
+    std::vector<Meshlet> meshlets;
+    bool with_meshlets = true;
+    // continuous LOD over clusters, built by load() with with_cluster_lod;
+    // the simplified clusters' indices are in cluster_faces
+    std::vector<Cluster> clusters;
+    std::vector<GLuint> cluster_faces;
+    bool with_cluster_lod = false;
+    // vertex -> face adjacency of faces, reused by refresh_normals()
+    NormalBuilder normal_builder;
 
     // constructors
-    Mesh(std::vector<Vertex> _vertices, std::vector<GLuint> faces);
+    Mesh(std::vector<glm::vec3> _positions, std::vector<glm::vec4> _colors,
+         std::vector<glm::vec3> _normals, std::vector<GLuint> _faces);
     Mesh(std::string filepath);
     Mesh() = default;
+    // meshes can hold gigabytes and own GPU buffers, copies are never
+    // implicit
+    Mesh(const Mesh &) = delete;
+    Mesh &operator=(const Mesh &) = delete;
+    Mesh(Mesh &&) noexcept = default;
+    Mesh &operator=(Mesh &&) noexcept = default;
+
+    // reads the file and computes the geometry without any OpenGL call, so
+    // it can run off the render thread; false on error or cancellation
+    bool load(const std::string &filepath, LoadProgress *progress = nullptr);
+    // creates the GPU buffers, render thread only
+    void upload();
+    // scales the mesh into the view and turns its z axis up
+    void reset_model_matrix();
 
     void draw(Shader &shader);
+    // picks the level draw() uses from the projected size of the bounding
+    // box; view_model and proj as given to the shader
+    void select_lod(const glm::mat4 &view_model, const glm::mat4 &proj,
+                    float viewport_height);
+    // 0 for faces, i for lods[i - 1]
+    uint32_t get_lod() const { return lod; }
+    // draw() leaves out the meshlets outside the view (or facing away from
+    // the eye, see visible_meshlets()) until the next call; it draws
+    // everything before the first one
+    void cull_meshlets(const glm::mat4 &view_model, const glm::mat4 &proj,
+                       bool cull_backfaces);
+    // same with the cut through the cluster hierarchy that is fine enough
+    // for the view, see visible_clusters(); replaces select_lod() and
+    // cull_meshlets() for meshes with clusters
+    void cull_clusters(const glm::mat4 &view_model, const glm::mat4 &proj,
+                       float viewport_height);
+    uint64_t vertex_count() const { return positions.size(); }
+    // resizes every attribute array, new vertices are DEFAULT_COLOR and
+    // have no normal
+    void resize_vertices(uint64_t count);
+
+    // re-uploads the vertices after their attributes changed on the CPU
+    void update_vertices();
+    // recomputes normals after an edit; the adjacency is only rebuilt when
+    // faces changed
+    void refresh_normals(bool faces_changed);
 
     glm::mat4 get_model_matrix();
-    Mesh scale(float s);
-    Mesh scale(glm::vec3 s);
+    // change the model matrix in place and return the mesh for chaining
+    Mesh &scale(float s);
+    Mesh &scale(glm::vec3 s);
 
-    Mesh translate(float t);
-    Mesh translate(glm::vec3 t);
-    Mesh rotate(float angle, glm::vec3 axis);
+    Mesh &translate(float t);
+    Mesh &translate(glm::vec3 t);
+    Mesh &rotate(float angle, glm::vec3 axis);
 
     Mesh highlight_triangle(uint32_t tri_idx);
     Mesh construct_bounding_box();
 
-    std::array<glm::vec3, 3> get_triangle_vertices(Triangle &tri) const;
+    std::array<glm::vec3, 3> get_triangle_vertices(const Triangle &tri) const;
+    // index into parts of the part owning triangle tri_idx
+    uint32_t find_part(uint64_t tri_idx) const;
+    // true when the parts follow each other without gaps and end at
+    // faces.size(), which every pass over them relies on
+    bool parts_cover_faces() const;
 
   private:
-    GLuint VAO, VBO, EBO;
+    GPUMesh gpu;
+    // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, picked by setup_mesh()
+    GLenum index_type = GL_UNSIGNED_INT;
+    // maps packed positions back to model space, identity for Float
+    glm::mat4 dequantize{1.0f};
+    uint32_t lod = 0;
+    // index ranges left by cull_meshlets() or cull_clusters(), for
+    // glMultiDrawElements
+    bool culled = false;
+    std::vector<GLsizei> draw_counts;
+    std::vector<const void *> draw_offsets;
     void setup_mesh();
+    std::vector<Vertex> interleave_vertices() const;
+    std::vector<PackedVertex> pack_vertices();
+    void upload_indices();
+    void set_draw_ranges(
+        const std::vector<std::pair<uint64_t, uint64_t>> &ranges);
 };
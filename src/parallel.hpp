@@ -0,0 +1,52 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// number of threads the parallel helpers spread their work on
+inline uint32_t num_workers() {
+    uint32_t n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
+
+/*
+    Splits [0, count) into chunks of `grain` items and hands them out to the
+    workers through a shared counter, so uneven chunks (e.g. slabs near the
+    surface vs. empty ones) still balance out. fn(begin, end, worker) is
+    called once per chunk; `worker` is stable per thread and can be used to
+    index per-thread scratch buffers.
+*/
+template <typename Fn>
+void parallel_for(uint64_t count, uint64_t grain, Fn &&fn) {
+    if (count == 0)
+        return;
+    grain = std::max<uint64_t>(grain, 1);
+    uint64_t chunks = (count + grain - 1) / grain;
+    uint32_t workers =
+        (uint32_t)std::min<uint64_t>(num_workers(), chunks);
+    if (workers <= 1) {
+        for (uint64_t b = 0; b < count; b += grain)
+            fn(b, std::min(b + grain, count), 0u);
+        return;
+    }
+    std::atomic<uint64_t> next{0};
+    auto run = [&](uint32_t worker) {
+        for (;;) {
+            uint64_t b = next.fetch_add(grain);
+            if (b >= count)
+                return;
+            fn(b, std::min(b + grain, count), worker);
+        }
+    };
+    std::vector<std::thread> threads;
+    threads.reserve(workers - 1);
+    for (uint32_t w = 1; w < workers; w++)
+        threads.emplace_back(run, w);
+    // the calling thread takes part as worker 0
+    run(0);
+    for (auto &t : threads)
+        t.join();
+}
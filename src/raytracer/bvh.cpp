@@ -167,13 +167,24 @@ BVH::BVH(Mesh &_mesh){
     mesh = &_mesh;
     tris = std::vector<uint32_t>(mesh->triangles.size());
     std::iota(tris.begin(), tris.end(), 0);
-    nodes.reserve(2 * mesh->triangles.size() - 1);
-    std::fill(nodes.begin(), nodes.end(), BVHNode());
+    // a binary tree with n leaves has at most 2n - 1 nodes, the nodes have to
+    // exist (not only be reserved) since they are indexed directly below
+    nodes = std::vector<BVHNode>(glm::max<size_t>(2 * tris.size(), 2) - 1);
     nodes[0].left = 0;
     nodes[0].first_prim_idx = 0;
     nodes[0].prim_count = tris.size();
     nodes[0].box = mesh->bounding_box;
     subdivide_primitives(0);
+    // drop the slots the midpoint splits never used
+    nodes.resize(counter);
+    nodes.shrink_to_fit();
+}
+
+BVH::BVH(Mesh &_mesh, std::vector<BVHNode> _nodes, std::vector<uint32_t> _tris){
+    mesh = &_mesh;
+    nodes = std::move(_nodes);
+    tris = std::move(_tris);
+    counter = nodes.size();
 }
 
 void BVH::update_bounds(uint32_t node_idx){
@@ -279,4 +290,156 @@ std::optional<uint32_t> Ray::intersects_bvh_internal(BVH &bvh, uint32_t idx){
     // }
     // fallback to right node if no intersection found in the left one
     return intersects_bvh_internal(bvh, node.left + 1);
-}
\ No newline at end of file
+}
+
+std::optional<RayHit> Ray::nearest_hit(BVH &bvh, uint32_t ignore_tri){
+    RayHit best{UINT32_MAX, INFINITY};
+    nearest_hit_internal(bvh, 0, ignore_tri, best);
+    if(best.tri_idx == UINT32_MAX)
+        return std::nullopt;
+    return best;
+}
+
+void Ray::nearest_hit_internal(BVH &bvh, uint32_t idx, uint32_t ignore_tri,
+                               RayHit &best){
+    BVHNode& node = bvh.get_node(idx);
+    if(node.isleaf()){
+        for(uint32_t i = 0; i < node.prim_count ; i++){
+            Triangle & tri =  bvh.get_triangle(node.first_prim_idx + i);
+            if(tri.id == ignore_tri)
+                continue;
+            auto opt = intersects_triangle(bvh.mesh, tri);
+            if(opt.has_value() && opt.value() < best.t)
+                best = RayHit{tri.id, opt.value()};
+        }
+        return;
+    }
+    // descend into the nearer child first, the farther one is skipped when
+    // its box starts past the best hit so far
+    uint32_t near = node.left, far = node.left + 1;
+    float near_dist = dist_to_aabb(bvh.get_node(near).box);
+    float far_dist = dist_to_aabb(bvh.get_node(far).box);
+    if(far_dist < near_dist){
+        std::swap(near, far);
+        std::swap(near_dist, far_dist);
+    }
+    if(near_dist < best.t)
+        nearest_hit_internal(bvh, near, ignore_tri, best);
+    if(far_dist < best.t)
+        nearest_hit_internal(bvh, far, ignore_tri, best);
+}
+
+void Ray::collect_hits(BVH &bvh, std::vector<float> &hits){
+    collect_hits_internal(bvh, 0, hits);
+}
+
+void Ray::collect_hits_internal(BVH &bvh, uint32_t idx,
+                                std::vector<float> &hits){
+    BVHNode& node = bvh.get_node(idx);
+    if(!intersects_aabb(node.box).has_value())
+        return;
+    if(node.isleaf()){
+        for(uint32_t i = 0; i < node.prim_count ; i++){
+            Triangle & tri =  bvh.get_triangle(node.first_prim_idx + i);
+            auto opt = intersects_triangle(bvh.mesh, tri);
+            if(opt.has_value())
+                hits.push_back(opt.value());
+        }
+        return;
+    }
+    collect_hits_internal(bvh, node.left, hits);
+    collect_hits_internal(bvh, node.left + 1, hits);
+}
+
+// Ericson, Real-Time Collision Detection, 5.1.5
+glm::vec3 closest_point_on_triangle(const glm::vec3 &p, const glm::vec3 &a,
+                                    const glm::vec3 &b, const glm::vec3 &c){
+    glm::vec3 ab = b - a;
+    glm::vec3 ac = c - a;
+    glm::vec3 ap = p - a;
+    float d1 = glm::dot(ab, ap);
+    float d2 = glm::dot(ac, ap);
+    // vertex region of a
+    if(d1 <= 0.0f && d2 <= 0.0f)
+        return a;
+
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp);
+    float d4 = glm::dot(ac, bp);
+    // vertex region of b
+    if(d3 >= 0.0f && d4 <= d3)
+        return b;
+
+    // edge region of ab
+    float vc = d1 * d4 - d3 * d2;
+    if(vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        return a + ab * (d1 / (d1 - d3));
+
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp);
+    float d6 = glm::dot(ac, cp);
+    // vertex region of c
+    if(d6 >= 0.0f && d5 <= d6)
+        return c;
+
+    // edge region of ac
+    float vb = d5 * d2 - d1 * d6;
+    if(vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        return a + ac * (d2 / (d2 - d6));
+
+    // edge region of bc
+    float va = d3 * d6 - d5 * d4;
+    if(va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+    // inside the face, project onto the plane
+    float denom = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+// squared distance from p to the box, zero if p is inside
+static float dist2_to_aabb(const glm::vec3 &p, const AABB &box){
+    glm::vec3 d = glm::max(glm::max(box.min - p, p - box.max), glm::vec3(0.0f));
+    return glm::dot(d, d);
+}
+
+std::optional<ClosestPoint> BVH::closest_point(const glm::vec3 &p,
+                                               float max_dist) const {
+    ClosestPoint best{0, glm::vec3(0.0f), max_dist * max_dist};
+    if(tris.empty())
+        return std::nullopt;
+    closest_point_internal(p, 0, best);
+    if(best.dist2 >= max_dist * max_dist)
+        return std::nullopt;
+    return best;
+}
+
+void BVH::closest_point_internal(const glm::vec3 &p, uint32_t node_idx,
+                                 ClosestPoint &best) const {
+    const BVHNode& node = nodes[node_idx];
+    if(node.prim_count > 0){
+        for(uint32_t i = 0; i < node.prim_count; i++){
+            uint32_t tri_idx = tris[node.first_prim_idx + i];
+            auto [a, b, c] =
+                mesh->get_triangle_vertices(mesh->triangles[tri_idx]);
+            glm::vec3 q = closest_point_on_triangle(p, a, b, c);
+            glm::vec3 d = q - p;
+            float dist2 = glm::dot(d, d);
+            if(dist2 < best.dist2)
+                best = ClosestPoint{tri_idx, q, dist2};
+        }
+        return;
+    }
+    // visit the nearer child first so the farther one is likely pruned
+    uint32_t near = node.left, far = node.left + 1;
+    float near_dist = dist2_to_aabb(p, nodes[near].box);
+    float far_dist = dist2_to_aabb(p, nodes[far].box);
+    if(far_dist < near_dist){
+        std::swap(near, far);
+        std::swap(near_dist, far_dist);
+    }
+    if(near_dist < best.dist2)
+        closest_point_internal(p, near, best);
+    if(far_dist < best.dist2)
+        closest_point_internal(p, far, best);
+}
@@ -3,6 +3,7 @@
 #include <glm/detail/func_geometric.hpp>
 #include <glm/ext.hpp>
 #include <glm/vec3.hpp>
+#include <cmath>
 #include <optional>
 
 #include "../mesh.hpp"
@@ -18,10 +19,19 @@ struct BVHNode {
     BVHNode() = default;
 };
 
+// result of a closest point query
+struct ClosestPoint {
+    uint32_t tri_idx;
+    glm::vec3 point;
+    float dist2;
+};
+
 class BVH {
 public:
     BVH() = default;
     BVH(Mesh &mesh);
+    // a tree built earlier for the same mesh, e.g. read from a cache file
+    BVH(Mesh &mesh, std::vector<BVHNode> nodes, std::vector<uint32_t> tris);
 
     BVHNode& get_node(uint32_t idx){
         return nodes[idx];
@@ -31,6 +41,23 @@ public:
         return mesh->triangles[tris[idx]];
     }
 
+    uint32_t node_count() const {
+        return counter;
+    }
+
+    const std::vector<BVHNode>& get_nodes() const {
+        return nodes;
+    }
+
+    const std::vector<uint32_t>& get_tris() const {
+        return tris;
+    }
+
+    // closest point on the mesh surface to p, ignoring triangles farther
+    // than max_dist
+    std::optional<ClosestPoint> closest_point(const glm::vec3 &p,
+                                              float max_dist = INFINITY) const;
+
     Mesh *mesh;
 private:
     std::vector<BVHNode> nodes;
@@ -38,6 +65,15 @@ private:
     uint32_t counter = 1;
     void update_bounds(uint32_t node_idx);
     void subdivide_primitives(uint32_t node_idx);
+    void closest_point_internal(const glm::vec3 &p, uint32_t node_idx,
+                                ClosestPoint &best) const;
+};
+
+struct RayHit {
+    // index into Mesh::triangles
+    uint32_t tri_idx;
+    // distance along the ray in units of dir
+    float t;
 };
 
 struct Ray {
@@ -53,13 +89,26 @@ struct Ray {
     std::optional<float> intersects_aabb_vectorized(const AABB &box);
     std::optional<float> intersects_aabb(const AABB &box);
     std::optional<uint32_t> intersects_bvh(BVH &bvh);
+    // closest hit along the ray, unlike intersects_bvh which stops at the
+    // first leaf with a hit
+    std::optional<RayHit> nearest_hit(BVH &bvh,
+                                      uint32_t ignore_tri = UINT32_MAX);
+    // distances of all the triangle crossings along the ray
+    void collect_hits(BVH &bvh, std::vector<float> &hits);
     // distance computation
     float dist_to_aabb(const AABB &box);
     
 private:
     std::optional<uint32_t> intersects_bvh_internal(BVH &bvh, uint32_t idx);
+    void nearest_hit_internal(BVH &bvh, uint32_t idx, uint32_t ignore_tri,
+                              RayHit &best);
+    void collect_hits_internal(BVH &bvh, uint32_t idx,
+                               std::vector<float> &hits);
 };
 
+glm::vec3 closest_point_on_triangle(const glm::vec3 &p, const glm::vec3 &a,
+                                    const glm::vec3 &b, const glm::vec3 &c);
+
 Ray mouse_to_object_space(glm::vec2 mouse, glm::vec4 viewport,
                           glm::mat4 &view_model, glm::mat4 &proj);
 
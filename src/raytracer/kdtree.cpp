@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <numeric>
+#include <thread>
+
+#include "kdtree.hpp"
+#include "../parallel.hpp"
+
+static bool closer(const Neighbor &a, const Neighbor &b) {
+    return a.dist2 < b.dist2;
+}
+
+KDTree::KDTree(const std::vector<glm::vec3> &_points) {
+    points = _points;
+    ids = std::vector<uint32_t>(points.size());
+    std::iota(ids.begin(), ids.end(), 0);
+    axes = std::vector<uint8_t>(points.size(), 0);
+    build(0, points.size(), 0);
+    // the build only moves ids, the points follow once at the end
+    std::vector<glm::vec3> sorted(points.size());
+    parallel_for(points.size(), 1 << 16,
+                 [&](uint64_t begin, uint64_t end, uint32_t) {
+                     for (uint64_t i = begin; i < end; i++)
+                         sorted[i] = points[ids[i]];
+                 });
+    points = std::move(sorted);
+}
+
+KDTree KDTree::from_vertices(const Mesh &mesh) {
+    return KDTree(mesh.positions);
+}
+
+KDTree KDTree::from_centroids(const Mesh &mesh) {
+    std::vector<glm::vec3> points(mesh.triangles.size());
+    for (size_t i = 0; i < points.size(); i++)
+        points[i] = mesh.triangles[i].centroid;
+    return KDTree(points);
+}
+
+void KDTree::build(uint32_t lo, uint32_t hi, uint32_t depth) {
+    if (hi - lo <= 1)
+        return;
+    glm::vec3 min(1e30f), max(-1e30f);
+    for (uint32_t i = lo; i < hi; i++) {
+        min = glm::min(min, points[ids[i]]);
+        max = glm::max(max, points[ids[i]]);
+    }
+    glm::vec3 diff = max - min;
+    uint8_t axis = 0;
+    if (diff.y > diff.x)
+        axis = 1;
+    if (diff.z > diff[axis])
+        axis = 2;
+
+    // partition the ids in place, points stay in input order until the end
+    uint32_t mid = (lo + hi) / 2;
+    std::nth_element(ids.begin() + lo, ids.begin() + mid, ids.begin() + hi,
+                     [&](uint32_t a, uint32_t b) {
+                         return points[a][axis] < points[b][axis];
+                     });
+    axes[mid] = axis;
+
+    // the two halves are disjoint, build them on separate threads until
+    // every worker has a subtree
+    if ((1u << depth) < num_workers() && hi - lo > (1u << 16)) {
+        std::thread left([&] { build(lo, mid, depth + 1); });
+        build(mid + 1, hi, depth + 1);
+        left.join();
+        return;
+    }
+    build(lo, mid, depth + 1);
+    build(mid + 1, hi, depth + 1);
+}
+
+std::optional<Neighbor> KDTree::nearest(const glm::vec3 &p) const {
+    std::vector<Neighbor> result = nearest(p, 1);
+    if (result.empty())
+        return std::nullopt;
+    return result[0];
+}
+
+std::vector<Neighbor> KDTree::nearest(const glm::vec3 &p, uint32_t k) const {
+    std::vector<Neighbor> heap;
+    if (k == 0)
+        return heap;
+    heap.reserve(k);
+    nearest_internal(p, 0, points.size(), k, heap);
+    std::sort_heap(heap.begin(), heap.end(), closer);
+    return heap;
+}
+
+// heap is a max-heap on distance holding the best k so far
+void KDTree::nearest_internal(const glm::vec3 &p, uint32_t lo, uint32_t hi,
+                              uint32_t k, std::vector<Neighbor> &heap) const {
+    if (lo >= hi)
+        return;
+    uint32_t mid = (lo + hi) / 2;
+    glm::vec3 d = points[mid] - p;
+    float dist2 = glm::dot(d, d);
+    if (heap.size() < k) {
+        heap.push_back(Neighbor{ids[mid], dist2});
+        std::push_heap(heap.begin(), heap.end(), closer);
+    } else if (dist2 < heap.front().dist2) {
+        std::pop_heap(heap.begin(), heap.end(), closer);
+        heap.back() = Neighbor{ids[mid], dist2};
+        std::push_heap(heap.begin(), heap.end(), closer);
+    }
+    if (hi - lo == 1)
+        return;
+
+    uint8_t axis = axes[mid];
+    float delta = p[axis] - points[mid][axis];
+    // search the side of the split p is on first
+    if (delta < 0.0f) {
+        nearest_internal(p, lo, mid, k, heap);
+        if (heap.size() < k || delta * delta < heap.front().dist2)
+            nearest_internal(p, mid + 1, hi, k, heap);
+    } else {
+        nearest_internal(p, mid + 1, hi, k, heap);
+        if (heap.size() < k || delta * delta < heap.front().dist2)
+            nearest_internal(p, lo, mid, k, heap);
+    }
+}
+
+std::vector<Neighbor>
+KDTree::nearest(const std::vector<glm::vec3> &queries, uint32_t k) const {
+    std::vector<Neighbor> result(queries.size() * k,
+                                 Neighbor{UINT32_MAX, INFINITY});
+    parallel_for(queries.size(), 1024,
+                 [&](uint64_t begin, uint64_t end, uint32_t) {
+                     std::vector<Neighbor> heap;
+                     heap.reserve(k);
+                     for (uint64_t i = begin; i < end; i++) {
+                         heap.clear();
+                         nearest_internal(queries[i], 0, points.size(), k,
+                                          heap);
+                         std::sort_heap(heap.begin(), heap.end(), closer);
+                         std::copy(heap.begin(), heap.end(),
+                                   result.begin() + i * k);
+                     }
+                 });
+    return result;
+}
+
+void KDTree::within_radius(const glm::vec3 &p, float radius,
+                           std::vector<Neighbor> &result) const {
+    within_radius_internal(p, radius * radius, 0, points.size(), result);
+}
+
+void KDTree::within_radius_internal(const glm::vec3 &p, float radius2,
+                                    uint32_t lo, uint32_t hi,
+                                    std::vector<Neighbor> &result) const {
+    if (lo >= hi)
+        return;
+    uint32_t mid = (lo + hi) / 2;
+    glm::vec3 d = points[mid] - p;
+    float dist2 = glm::dot(d, d);
+    if (dist2 <= radius2)
+        result.push_back(Neighbor{ids[mid], dist2});
+    if (hi - lo == 1)
+        return;
+    uint8_t axis = axes[mid];
+    float delta = p[axis] - points[mid][axis];
+    if (delta <= 0.0f || delta * delta <= radius2)
+        within_radius_internal(p, radius2, lo, mid, result);
+    if (delta >= 0.0f || delta * delta <= radius2)
+        within_radius_internal(p, radius2, mid + 1, hi, result);
+}
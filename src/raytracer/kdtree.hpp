@@ -0,0 +1,53 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <optional>
+#include <vector>
+
+#include "../mesh.hpp"
+
+struct Neighbor {
+    // index of the point as it was passed to the tree
+    uint32_t idx;
+    float dist2;
+};
+
+/*
+    Implicit k-d tree: the points are permuted so that every range [lo, hi)
+    is a subtree whose median sits at (lo + hi) / 2, so no node structs or
+    child pointers are stored. The split axis of each node is the longest
+    side of its range's bounding box.
+*/
+class KDTree {
+  public:
+    KDTree() = default;
+    KDTree(const std::vector<glm::vec3> &points);
+
+    static KDTree from_vertices(const Mesh &mesh);
+    static KDTree from_centroids(const Mesh &mesh);
+
+    std::optional<Neighbor> nearest(const glm::vec3 &p) const;
+    // the k closest points sorted by distance, fewer if the tree is smaller
+    std::vector<Neighbor> nearest(const glm::vec3 &p, uint32_t k) const;
+    // k results per query laid out back to back, queries spread on all
+    // workers; missing neighbors have idx UINT32_MAX
+    std::vector<Neighbor> nearest(const std::vector<glm::vec3> &queries,
+                                  uint32_t k) const;
+    // every point within radius of p, unsorted
+    void within_radius(const glm::vec3 &p, float radius,
+                       std::vector<Neighbor> &result) const;
+
+    size_t size() const { return points.size(); }
+
+  private:
+    std::vector<glm::vec3> points;
+    std::vector<uint32_t> ids;
+    std::vector<uint8_t> axes;
+
+    void build(uint32_t lo, uint32_t hi, uint32_t depth);
+    void nearest_internal(const glm::vec3 &p, uint32_t lo, uint32_t hi,
+                          uint32_t k, std::vector<Neighbor> &heap) const;
+    void within_radius_internal(const glm::vec3 &p, float radius2, uint32_t lo,
+                                uint32_t hi,
+                                std::vector<Neighbor> &result) const;
+};
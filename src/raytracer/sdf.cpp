@@ -0,0 +1,104 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+#include "sdf.hpp"
+#include "winding.hpp"
+#include "../parallel.hpp"
+
+/*
+    The sign of a voxel is resolved per row: one ray is shot along +x through
+    the voxel centers of the row and every crossing toggles inside/outside, so
+    a whole row costs a single BVH traversal. The distance itself is an
+    unsigned closest point query which, with a narrow band, prunes every BVH
+    node farther than the band and returns early for far voxels.
+    With a winding number the row ray is skipped and every voxel is
+    classified on its own.
+*/
+static void compute_row(BVH &bvh, const WindingNumber *winding, SDFGrid &grid,
+                        uint32_t y, uint32_t z, std::vector<float> &hits) {
+    glm::vec3 start = grid.voxel_center(0, y, z);
+    // nudge the ray off the voxel centers, axis aligned parts often have
+    // faces and edges exactly on the grid planes
+    float nudge = 1e-4f * grid.voxel_size;
+    Ray ray;
+    ray.origin = start + glm::vec3(-grid.voxel_size, nudge, 0.5f * nudge);
+    ray.dir = glm::vec3(1.0f, 0.0f, 0.0f);
+
+    hits.clear();
+    if (!winding)
+        ray.collect_hits(bvh, hits);
+    std::sort(hits.begin(), hits.end());
+    // a ray through a shared edge hits both triangles, count it once
+    auto last = std::unique(hits.begin(), hits.end(), [&](float a, float b) {
+        return b - a < nudge;
+    });
+    hits.erase(last, hits.end());
+
+    float max_dist = grid.band > 0.0f ? grid.band : INFINITY;
+    uint32_t crossings = 0;
+    for (uint32_t x = 0; x < grid.dims.x; x++) {
+        glm::vec3 p = grid.voxel_center(x, y, z);
+        float t = p.x - ray.origin.x;
+        while (crossings < hits.size() && hits[crossings] < t)
+            crossings++;
+        bool inside = winding ? winding->is_inside(p) : (crossings & 1);
+        float sign = inside ? -1.0f : 1.0f;
+        auto closest = bvh.closest_point(p, max_dist);
+        float dist = closest.has_value() ? glm::sqrt(closest->dist2) : max_dist;
+        grid.at(x, y, z) = sign * dist;
+    }
+}
+
+SDFGrid compute_sdf(BVH &bvh, const SDFOptions &opts) {
+    SDFGrid grid;
+    const AABB &box = bvh.mesh->bounding_box;
+    glm::vec3 extent = box.max - box.min;
+    float longest = glm::max(extent.x, extent.y, extent.z);
+    if (opts.resolution == 0 || !(longest > 0.0f)) {
+        std::cerr << "ERROR::SDF::EMPTY_GRID" << std::endl;
+        return grid;
+    }
+    grid.voxel_size = longest / (float)opts.resolution;
+    grid.band = opts.narrow_band * grid.voxel_size;
+    for (int i = 0; i < 3; i++)
+        grid.dims[i] = (uint32_t)glm::ceil(extent[i] / grid.voxel_size) + 1 +
+                       2 * opts.padding;
+    grid.origin = box.min - (float)opts.padding * grid.voxel_size;
+    grid.values.resize((uint64_t)grid.dims.x * grid.dims.y * grid.dims.z);
+
+    WindingNumber winding;
+    if (opts.sign == SDFSign::Winding)
+        winding = WindingNumber(bvh);
+    const WindingNumber *winding_ptr =
+        opts.sign == SDFSign::Winding ? &winding : nullptr;
+
+    // one z slab per work item, slabs through the mesh cost more than empty
+    // ones so they are handed out dynamically
+    std::vector<std::vector<float>> scratch(num_workers());
+    parallel_for(grid.dims.z, 1, [&](uint64_t begin, uint64_t end,
+                                     uint32_t worker) {
+        for (uint64_t z = begin; z < end; z++)
+            for (uint32_t y = 0; y < grid.dims.y; y++)
+                compute_row(bvh, winding_ptr, grid, y, (uint32_t)z,
+                            scratch[worker]);
+    });
+    return grid;
+}
+
+bool SDFGrid::write(const std::string &filepath) const {
+    std::ofstream file(filepath, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "ERROR::SDF::CANNOT_OPEN::" << filepath << std::endl;
+        return false;
+    }
+    const uint32_t version = 1;
+    file.write("MSDF", 4);
+    file.write((const char *)&version, sizeof(version));
+    file.write((const char *)&dims[0], 3 * sizeof(uint32_t));
+    file.write((const char *)&origin[0], 3 * sizeof(float));
+    file.write((const char *)&voxel_size, sizeof(float));
+    file.write((const char *)&band, sizeof(float));
+    file.write((const char *)values.data(), values.size() * sizeof(float));
+    return file.good();
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <string>
+#include <vector>
+
+#include "bvh.hpp"
+
+enum class SDFSign {
+    // crossings along one ray per row, fast but needs a watertight mesh
+    Parity,
+    // fast winding number per voxel, robust to holes in scans
+    Winding,
+};
+
+struct SDFOptions {
+    // number of voxels along the longest side of the bounding box
+    uint32_t resolution = 64;
+    // empty voxels added around the bounding box on each side
+    uint32_t padding = 2;
+    // only voxels within this many voxels from the surface get an exact
+    // distance, the rest are clamped to +-band; 0 computes every voxel
+    float narrow_band = 0.0f;
+    SDFSign sign = SDFSign::Parity;
+};
+
+// signed distance grid, negative inside the mesh
+struct SDFGrid {
+    glm::uvec3 dims{0};
+    // position of the center of voxel (0, 0, 0)
+    glm::vec3 origin{0.0f};
+    float voxel_size = 0.0f;
+    // clamp distance in mesh units, 0 if the grid is exact everywhere
+    float band = 0.0f;
+    // x varies fastest, then y, then z
+    std::vector<float> values;
+
+    float &at(uint32_t x, uint32_t y, uint32_t z) {
+        return values[x + dims.x * (y + (uint64_t)dims.y * z)];
+    }
+    glm::vec3 voxel_center(uint32_t x, uint32_t y, uint32_t z) const {
+        return origin + voxel_size * glm::vec3((float)x, (float)y, (float)z);
+    }
+
+    // layout: "MSDF", version, dims, origin, voxel_size, band (all 4 bytes
+    // little endian) followed by the float values
+    bool write(const std::string &filepath) const;
+};
+
+SDFGrid compute_sdf(BVH &bvh, const SDFOptions &opts);
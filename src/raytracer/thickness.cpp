@@ -0,0 +1,59 @@
+#include <cmath>
+
+#include "thickness.hpp"
+#include "../parallel.hpp"
+
+std::vector<float> compute_wall_thickness(BVH &bvh) {
+    Mesh &mesh = *bvh.mesh;
+    std::vector<float> thickness(mesh.triangles.size(), INFINITY);
+    parallel_for(mesh.triangles.size(), 1024,
+                 [&](uint64_t begin, uint64_t end, uint32_t) {
+                     for (uint64_t i = begin; i < end; i++) {
+                         Triangle &tri = mesh.triangles[i];
+                         auto [a, b, c] = mesh.get_triangle_vertices(tri);
+                         glm::vec3 normal = glm::cross(b - a, c - a);
+                         float len = glm::length(normal);
+                         if (!(len > 0.0f))
+                             continue;
+                         Ray ray;
+                         ray.origin = tri.centroid;
+                         ray.dir = -normal / len;
+                         auto hit = ray.nearest_hit(bvh, tri.id);
+                         if (hit.has_value())
+                             thickness[i] = hit->t;
+                     }
+                 });
+    return thickness;
+}
+
+// red -> yellow -> green as the wall gets thicker
+static glm::vec4 thickness_color(float t, const ThicknessOptions &opts) {
+    float range = opts.max_thickness - opts.min_thickness;
+    float x = range > 0.0f ? (t - opts.min_thickness) / range
+                           : (t > opts.min_thickness ? 1.0f : 0.0f);
+    x = glm::clamp(x, 0.0f, 1.0f);
+    if (x < 0.5f)
+        return glm::vec4(1.0f, 2.0f * x, 0.0f, 1.0f);
+    return glm::vec4(2.0f - 2.0f * x, 1.0f, 0.0f, 1.0f);
+}
+
+void color_by_thickness(Mesh &mesh, const std::vector<float> &thickness,
+                        const ThicknessOptions &opts) {
+    std::vector<float> vertex_thickness(mesh.vertex_count(), INFINITY);
+    for (size_t i = 0; i < mesh.triangles.size(); i++) {
+        for (int k = 0; k < 3; k++) {
+            float &t = vertex_thickness[mesh.faces[3 * i + k]];
+            t = glm::min(t, thickness[i]);
+        }
+    }
+    parallel_for(mesh.vertex_count(), 1 << 16,
+                 [&](uint64_t begin, uint64_t end, uint32_t) {
+                     for (uint64_t i = begin; i < end; i++) {
+                         // leave vertices without a measurement untouched
+                         if (std::isinf(vertex_thickness[i]))
+                             continue;
+                         mesh.colors[i] =
+                             thickness_color(vertex_thickness[i], opts);
+                     }
+                 });
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <vector>
+
+#include "bvh.hpp"
+
+struct ThicknessOptions {
+    // walls at or below this thickness are painted red
+    float min_thickness = 1.0f;
+    // walls at or above this thickness are painted green
+    float max_thickness = 4.0f;
+};
+
+/*
+    Shoots a ray from every triangle centroid along its inverted face normal
+    and returns the distance to the nearest hit, i.e. the wall thickness
+    under that triangle. INFINITY where the ray leaves the mesh (holes or
+    inward facing triangles).
+*/
+std::vector<float> compute_wall_thickness(BVH &bvh);
+
+// writes the thickness into the vertex colors, a vertex takes the thinnest
+// wall of the triangles around it
+void color_by_thickness(Mesh &mesh, const std::vector<float> &thickness,
+                        const ThicknessOptions &opts);
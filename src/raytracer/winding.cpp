@@ -0,0 +1,101 @@
+#include <cmath>
+
+#include "winding.hpp"
+#include "../parallel.hpp"
+
+constexpr float INV_FOUR_PI = 0.25f / (float)M_PI;
+
+WindingNumber::WindingNumber(BVH &_bvh, float _beta) {
+    bvh = &_bvh;
+    beta = _beta;
+    dipoles = std::vector<Dipole>(bvh->node_count());
+    build(0);
+}
+
+// children are built first, parents are merged from their two dipoles
+void WindingNumber::build(uint32_t node_idx) {
+    BVHNode &node = bvh->get_node(node_idx);
+    Dipole &dipole = dipoles[node_idx];
+    if (node.isleaf()) {
+        dipole = Dipole{glm::vec3(0.0f), glm::vec3(0.0f), 0.0f, 0.0f};
+        for (uint32_t i = 0; i < node.prim_count; i++) {
+            auto [a, b, c] = bvh->mesh->get_triangle_vertices(
+                bvh->get_triangle(node.first_prim_idx + i));
+            glm::vec3 n = 0.5f * glm::cross(b - a, c - a);
+            float area = glm::length(n);
+            dipole.normal += n;
+            dipole.center += area * (a + b + c) / 3.0f;
+            dipole.area += area;
+        }
+        if (dipole.area > 0.0f)
+            dipole.center /= dipole.area;
+        for (uint32_t i = 0; i < node.prim_count; i++) {
+            for (auto &v : bvh->mesh->get_triangle_vertices(
+                     bvh->get_triangle(node.first_prim_idx + i)))
+                dipole.radius =
+                    glm::max(dipole.radius, glm::length(v - dipole.center));
+        }
+        return;
+    }
+    build(node.left);
+    build(node.left + 1);
+    const Dipole &l = dipoles[node.left];
+    const Dipole &r = dipoles[node.left + 1];
+    dipole.normal = l.normal + r.normal;
+    dipole.area = l.area + r.area;
+    dipole.center = dipole.area > 0.0f
+                        ? (l.area * l.center + r.area * r.center) / dipole.area
+                        : 0.5f * (l.center + r.center);
+    dipole.radius = glm::max(glm::length(l.center - dipole.center) + l.radius,
+                             glm::length(r.center - dipole.center) + r.radius);
+}
+
+// Van Oosterom and Strackee
+float triangle_winding(const glm::vec3 &q, const glm::vec3 &a,
+                       const glm::vec3 &b, const glm::vec3 &c) {
+    glm::vec3 qa = a - q, qb = b - q, qc = c - q;
+    float la = glm::length(qa), lb = glm::length(qb), lc = glm::length(qc);
+    float numerator = glm::dot(qa, glm::cross(qb, qc));
+    float denominator = la * lb * lc + glm::dot(qa, qb) * lc +
+                        glm::dot(qb, qc) * la + glm::dot(qc, qa) * lb;
+    return 2.0f * std::atan2(numerator, denominator) * INV_FOUR_PI;
+}
+
+float WindingNumber::evaluate(const glm::vec3 &q) const {
+    if (dipoles.empty() || bvh->mesh->triangles.empty())
+        return 0.0f;
+    return evaluate_internal(q, 0);
+}
+
+float WindingNumber::evaluate_internal(const glm::vec3 &q,
+                                       uint32_t node_idx) const {
+    const Dipole &dipole = dipoles[node_idx];
+    glm::vec3 d = dipole.center - q;
+    float dist = glm::length(d);
+    if (dist > beta * dipole.radius)
+        return glm::dot(dipole.normal, d) * INV_FOUR_PI / (dist * dist * dist);
+
+    BVHNode &node = bvh->get_node(node_idx);
+    if (node.isleaf()) {
+        float w = 0.0f;
+        for (uint32_t i = 0; i < node.prim_count; i++) {
+            auto [a, b, c] = bvh->mesh->get_triangle_vertices(
+                bvh->get_triangle(node.first_prim_idx + i));
+            w += triangle_winding(q, a, b, c);
+        }
+        return w;
+    }
+    return evaluate_internal(q, node.left) +
+           evaluate_internal(q, node.left + 1);
+}
+
+std::vector<float>
+WindingNumber::evaluate(const std::vector<glm::vec3> &points) const {
+    std::vector<float> result(points.size());
+    parallel_for(points.size(), 4096,
+                 [&](uint64_t begin, uint64_t end, uint32_t) {
+                     for (uint64_t i = begin; i < end; i++)
+                         result[i] = evaluate(points[i]);
+                 });
+    return result;
+}
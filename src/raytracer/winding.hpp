@@ -0,0 +1,49 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <vector>
+
+#include "bvh.hpp"
+
+/*
+    Fast generalized winding number (Barill et al. 2018) over the BVH.
+    Every node keeps a dipole: the area weighted normal of its triangles
+    placed at their area weighted centroid. Points farther than beta times
+    the node radius use the dipole instead of descending, nearby leaves are
+    summed exactly with the triangle solid angles.
+
+    The winding number is ~1 inside and ~0 outside a closed, outward facing
+    mesh and degrades gracefully on holes and non-manifold scans, unlike ray
+    parity.
+*/
+class WindingNumber {
+  public:
+    WindingNumber() = default;
+    WindingNumber(BVH &bvh, float beta = 2.0f);
+
+    float evaluate(const glm::vec3 &q) const;
+    bool is_inside(const glm::vec3 &q) const { return evaluate(q) > 0.5f; }
+
+    // evaluates a batch of points on all the workers
+    std::vector<float> evaluate(const std::vector<glm::vec3> &points) const;
+
+  private:
+    struct Dipole {
+        glm::vec3 center;
+        // sum of area * unit normal
+        glm::vec3 normal;
+        float area;
+        float radius;
+    };
+
+    BVH *bvh = nullptr;
+    float beta = 2.0f;
+    std::vector<Dipole> dipoles;
+
+    void build(uint32_t node_idx);
+    float evaluate_internal(const glm::vec3 &q, uint32_t node_idx) const;
+};
+
+// signed solid angle of the triangle seen from q, divided by 4 pi
+float triangle_winding(const glm::vec3 &q, const glm::vec3 &a,
+                       const glm::vec3 &b, const glm::vec3 &c);
@@ -0,0 +1,33 @@
+#include <utility>
+
+#include "gpu_mesh.hpp"
+
+GPUMesh::GPUMesh(GPUMesh &&other) noexcept
+    : VAO(std::exchange(other.VAO, 0)), VBO(std::exchange(other.VBO, 0)),
+      EBO(std::exchange(other.EBO, 0)) {}
+
+GPUMesh &GPUMesh::operator=(GPUMesh &&other) noexcept {
+    if (this != &other) {
+        release();
+        VAO = std::exchange(other.VAO, 0);
+        VBO = std::exchange(other.VBO, 0);
+        EBO = std::exchange(other.EBO, 0);
+    }
+    return *this;
+}
+
+void GPUMesh::create() {
+    release();
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &EBO);
+}
+
+void GPUMesh::release() {
+    if (!is_valid())
+        return;
+    glDeleteBuffers(1, &EBO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteVertexArrays(1, &VAO);
+    VAO = VBO = EBO = 0;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "../../include/glad.h"
+
+/*
+    Owns the VAO, VBO and EBO of one mesh and deletes them when it goes
+    away or is overwritten, so replacing a mesh frees its VRAM. Move-only:
+    two handles never own the same buffers. All calls need the GL context,
+    i.e. the render thread; an empty handle can live anywhere.
+*/
+class GPUMesh {
+  public:
+    GPUMesh() = default;
+    ~GPUMesh() { release(); }
+
+    GPUMesh(const GPUMesh &) = delete;
+    GPUMesh &operator=(const GPUMesh &) = delete;
+    GPUMesh(GPUMesh &&other) noexcept;
+    GPUMesh &operator=(GPUMesh &&other) noexcept;
+
+    // fresh buffers, the previous ones (if any) are released first
+    void create();
+    void release();
+    bool is_valid() const { return VAO != 0; }
+
+    GLuint get_vao() const { return VAO; }
+    GLuint get_vbo() const { return VBO; }
+    GLuint get_ebo() const { return EBO; }
+
+  private:
+    GLuint VAO = 0, VBO = 0, EBO = 0;
+};
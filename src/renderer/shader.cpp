@@ -81,4 +81,18 @@ void Shader::set_uniform(const char *var_name, glm::vec3 &vec) {
     }
 }
 
+void Shader::set_uniform(const char *var_name, int value) {
+    GLint location = glGetUniformLocation(shader_program, var_name);
+    if (location >= 0)
+        glUniform1i(location, value);
+    else {
+        std::cout << "Cannot find uniform varible" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+void Shader::set_uniform(const char *var_name, bool value) {
+    set_uniform(var_name, (int)value);
+}
+
 void Shader::use() { glUseProgram(shader_program); }
\ No newline at end of file
@@ -0,0 +1,251 @@
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+#include "slicer.hpp"
+#include "../parallel.hpp"
+
+namespace {
+
+struct Segment {
+    glm::vec2 a, b;
+};
+
+// range of layers a triangle crosses, empty when first > last
+struct LayerSpan {
+    int64_t first, last;
+};
+
+LayerSpan layer_span(const std::array<glm::vec3, 3> &v, float z0,
+                     float layer_height, int64_t layer_count) {
+    float lo = glm::min(v[0].z, v[1].z, v[2].z);
+    float hi = glm::max(v[0].z, v[1].z, v[2].z);
+    // plane k is at z0 + (k + 0.5) * h
+    int64_t first = (int64_t)glm::ceil((lo - z0) / layer_height - 0.5f);
+    int64_t last = (int64_t)glm::floor((hi - z0) / layer_height - 0.5f);
+    return {glm::max<int64_t>(first, 0),
+            glm::min<int64_t>(last, layer_count - 1)};
+}
+
+/*
+    Vertices exactly on the plane count as above it, so every triangle
+    either misses the plane or has exactly two edges crossing it. Both
+    triangles sharing an edge compute its crossing from the same (below,
+    above) endpoint order, which keeps the endpoints bitwise equal for the
+    stitching below.
+*/
+bool intersect_triangle(const std::array<glm::vec3, 3> &v, float z,
+                        Segment &seg) {
+    glm::vec2 points[2];
+    int count = 0;
+    for (int i = 0; i < 3; i++) {
+        glm::vec3 p = v[i], q = v[(i + 1) % 3];
+        bool p_above = p.z >= z, q_above = q.z >= z;
+        if (p_above == q_above)
+            continue;
+        if (p_above)
+            std::swap(p, q);
+        float t = (z - p.z) / (q.z - p.z);
+        points[count++] = glm::vec2(p.x + t * (q.x - p.x), p.y + t * (q.y - p.y));
+    }
+    // a vertex touching the plane with the rest below gives a point
+    if (count != 2 || points[0] == points[1])
+        return false;
+    // walk counter-clockwise around the outside, i.e. along z x normal
+    glm::vec3 normal = glm::cross(v[1] - v[0], v[2] - v[0]);
+    glm::vec2 dir(-normal.y, normal.x);
+    if (glm::dot(points[1] - points[0], dir) < 0.0f)
+        std::swap(points[0], points[1]);
+    seg = Segment{points[0], points[1]};
+    return true;
+}
+
+uint64_t point_key(const glm::vec2 &p) {
+    uint32_t x, y;
+    std::memcpy(&x, &p.x, sizeof(x));
+    std::memcpy(&y, &p.y, sizeof(y));
+    return ((uint64_t)x << 32) | y;
+}
+
+void stitch_contours(const Segment *segs, uint32_t count, Layer &layer) {
+    std::unordered_map<uint64_t, uint32_t> starts;
+    starts.reserve(count);
+    for (uint32_t i = 0; i < count; i++)
+        starts[point_key(segs[i].a)] = i;
+    std::vector<uint32_t> next(count, UINT32_MAX);
+    std::vector<bool> has_prev(count, false), visited(count, false);
+    for (uint32_t i = 0; i < count; i++) {
+        auto it = starts.find(point_key(segs[i].b));
+        if (it == starts.end())
+            continue;
+        next[i] = it->second;
+        has_prev[it->second] = true;
+    }
+
+    auto walk = [&](uint32_t first) {
+        Contour contour{{segs[first].a}, false};
+        uint32_t i = first;
+        while (i != UINT32_MAX && !visited[i]) {
+            visited[i] = true;
+            contour.points.push_back(segs[i].b);
+            i = next[i];
+        }
+        contour.closed = (i == first);
+        if (contour.closed)
+            contour.points.pop_back();
+        layer.contours.push_back(std::move(contour));
+    };
+    // open chains first so they are walked from their real start
+    for (uint32_t i = 0; i < count; i++)
+        if (!has_prev[i] && !visited[i])
+            walk(i);
+    for (uint32_t i = 0; i < count; i++)
+        if (!visited[i])
+            walk(i);
+}
+
+} // namespace
+
+/*
+    Two passes over the triangles: the first counts how many triangles span
+    every layer (a difference array over each triangle's z interval, merged
+    from per-worker copies), the second cuts each triangle against only the
+    planes in its interval and scatters the segments into per-layer slots.
+    The layers are then stitched independently, split across the workers by
+    layer ranges.
+*/
+Slices slice_mesh(const Mesh &mesh, float layer_height) {
+    Slices slices;
+    slices.layer_height = layer_height;
+    const AABB &box = mesh.bounding_box;
+    if (!(layer_height > 0.0f) || mesh.triangles.empty() ||
+        box.max.z < box.min.z)
+        return slices;
+    const float z0 = box.min.z;
+    const int64_t layer_count =
+        (int64_t)glm::floor((box.max.z - z0) / layer_height - 0.5f) + 1;
+    if (layer_count <= 0)
+        return slices;
+    const uint64_t tri_count = mesh.triangles.size();
+    const uint64_t grain = 1 << 14;
+
+    std::vector<std::vector<int64_t>> diffs(
+        num_workers(), std::vector<int64_t>(layer_count + 1, 0));
+    parallel_for(tri_count, grain,
+                 [&](uint64_t begin, uint64_t end, uint32_t worker) {
+                     auto &diff = diffs[worker];
+                     for (uint64_t i = begin; i < end; i++) {
+                         auto span = layer_span(
+                             mesh.get_triangle_vertices(mesh.triangles[i]), z0,
+                             layer_height, layer_count);
+                         if (span.first > span.last)
+                             continue;
+                         diff[span.first]++;
+                         diff[span.last + 1]--;
+                     }
+                 });
+    // offsets[k] is where layer k's segments start
+    std::vector<uint64_t> offsets(layer_count + 1, 0);
+    int64_t running = 0;
+    for (int64_t k = 0; k < layer_count; k++) {
+        for (auto &diff : diffs)
+            running += diff[k];
+        offsets[k + 1] = offsets[k] + running;
+    }
+    diffs.clear();
+
+    std::vector<Segment> segments(offsets[layer_count]);
+    std::vector<std::atomic<uint32_t>> fill(layer_count);
+    for (auto &f : fill)
+        f.store(0, std::memory_order_relaxed);
+    parallel_for(tri_count, grain, [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t i = begin; i < end; i++) {
+            auto v = mesh.get_triangle_vertices(mesh.triangles[i]);
+            auto span = layer_span(v, z0, layer_height, layer_count);
+            for (int64_t k = span.first; k <= span.last; k++) {
+                Segment seg;
+                float z = z0 + ((float)k + 0.5f) * layer_height;
+                if (!intersect_triangle(v, z, seg))
+                    continue;
+                uint32_t slot = fill[k].fetch_add(1, std::memory_order_relaxed);
+                segments[offsets[k] + slot] = seg;
+            }
+        }
+    });
+
+    slices.layers.resize(layer_count);
+    parallel_for(layer_count, 8, [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t k = begin; k < end; k++) {
+            Layer &layer = slices.layers[k];
+            layer.z = z0 + ((float)k + 0.5f) * layer_height;
+            stitch_contours(&segments[offsets[k]], fill[k].load(), layer);
+        }
+    });
+    return slices;
+}
+
+bool Slices::write(const std::string &filepath) const {
+    std::ofstream file(filepath, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "ERROR::SLICER::CANNOT_OPEN::" << filepath << std::endl;
+        return false;
+    }
+    const uint32_t version = 1;
+    const uint32_t layer_count = layers.size();
+    file.write("MSLC", 4);
+    file.write((const char *)&version, sizeof(version));
+    file.write((const char *)&layer_count, sizeof(layer_count));
+    file.write((const char *)&layer_height, sizeof(layer_height));
+    for (const Layer &layer : layers) {
+        const uint32_t contour_count = layer.contours.size();
+        file.write((const char *)&layer.z, sizeof(layer.z));
+        file.write((const char *)&contour_count, sizeof(contour_count));
+        for (const Contour &contour : layer.contours) {
+            const uint32_t closed = contour.closed;
+            const uint32_t point_count = contour.points.size();
+            file.write((const char *)&closed, sizeof(closed));
+            file.write((const char *)&point_count, sizeof(point_count));
+            file.write((const char *)contour.points.data(),
+                       point_count * sizeof(glm::vec2));
+        }
+    }
+    return file.good();
+}
+
+bool Slices::write_svg(const std::string &filepath) const {
+    std::ofstream file(filepath);
+    if (!file.is_open()) {
+        std::cerr << "ERROR::SLICER::CANNOT_OPEN::" << filepath << std::endl;
+        return false;
+    }
+    glm::vec2 lo(1e30f), hi(-1e30f);
+    for (const Layer &layer : layers)
+        for (const Contour &contour : layer.contours)
+            for (const glm::vec2 &p : contour.points) {
+                lo = glm::min(lo, p);
+                hi = glm::max(hi, p);
+            }
+    if (lo.x > hi.x)
+        lo = hi = glm::vec2(0.0f);
+    glm::vec2 size = hi - lo;
+    file << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+         << "<svg xmlns=\"http://www.w3.org/2000/svg\" viewBox=\"" << lo.x
+         << " " << -hi.y << " " << size.x << " " << size.y << "\">\n";
+    for (size_t k = 0; k < layers.size(); k++) {
+        file << "<g id=\"layer" << k << "\" data-z=\"" << layers[k].z
+             << "\" fill=\"none\" stroke=\"black\" stroke-width=\"0.1\">\n";
+        for (const Contour &contour : layers[k].contours) {
+            // svg y axis points down
+            file << (contour.closed ? "<polygon" : "<polyline")
+                 << " points=\"";
+            for (const glm::vec2 &p : contour.points)
+                file << p.x << "," << -p.y << " ";
+            file << "\"/>\n";
+        }
+        file << "</g>\n";
+    }
+    file << "</svg>\n";
+    return file.good();
+}
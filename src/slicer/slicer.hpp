@@ -0,0 +1,35 @@
+#pragma once
+
+#include <glm/vec2.hpp>
+#include <string>
+#include <vector>
+
+#include "../mesh.hpp"
+
+// polyline in the xy plane of one layer, outer boundaries run
+// counter-clockwise and holes clockwise when the mesh faces outward
+struct Contour {
+    std::vector<glm::vec2> points;
+    // false when the mesh has holes and the polyline could not be closed
+    bool closed;
+};
+
+struct Layer {
+    float z;
+    std::vector<Contour> contours;
+};
+
+struct Slices {
+    float layer_height = 0.0f;
+    std::vector<Layer> layers;
+
+    // layout: "MSLC", version, layer count, layer height, then per layer
+    // z and contour count, per contour the closed flag, point count and the
+    // xy float pairs (all 4 bytes little endian)
+    bool write(const std::string &filepath) const;
+    // one <g> group per layer, coordinates in mesh units
+    bool write_svg(const std::string &filepath) const;
+};
+
+// slices the mesh with planes z = min.z + (k + 0.5) * layer_height
+Slices slice_mesh(const Mesh &mesh, float layer_height);
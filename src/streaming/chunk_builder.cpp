@@ -0,0 +1,415 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+
+#include "chunk_builder.hpp"
+#include "../io/chunk_index.hpp"
+#include "../io/mapped_file.hpp"
+#include "../io/mesher_format.hpp"
+#include "../io/stl.hpp"
+#include "../parallel.hpp"
+#include "../raytracer/bvh.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr size_t STL_HEADER_SIZE = 84;
+constexpr size_t STL_RECORD_SIZE = 50;
+// per chunk, split between the workers; a worker's records of a chunk go to
+// the temporary file when its share is full
+constexpr size_t CHUNK_WRITE_BUFFER = 1 << 18;
+constexpr size_t MIN_WORKER_BUFFER = 1 << 14;
+
+// the triangles of the source, read from the mapped records of a binary
+// STL or from a mesh loaded whole
+class TriangleSource {
+  public:
+    bool open(const std::string &filepath) {
+        file = MappedFile(filepath);
+        if (is_binary_stl(file)) {
+            uint32_t facets;
+            std::memcpy(&facets, file.data() + 80, sizeof(facets));
+            count = facets;
+            return true;
+        }
+        file = MappedFile();
+        // only its triangles are read, none of the draw order or levels
+        mesh.reorder = false;
+        mesh.with_lods = false;
+        mesh.with_meshlets = false;
+        mesh.with_cluster_lod = false;
+        if (!mesh.load(filepath))
+            return false;
+        count = mesh.triangles.size();
+        return true;
+    }
+
+    uint64_t size() const { return count; }
+
+    void get(uint64_t i, glm::vec3 v[3]) const {
+        if (file.is_open()) {
+            // records are 50 bytes apart, the floats are not aligned
+            float xyz[9];
+            std::memcpy(xyz, file.data() + STL_HEADER_SIZE +
+                                 i * STL_RECORD_SIZE + 12,
+                        sizeof(xyz));
+            for (int k = 0; k < 3; k++)
+                v[k] = glm::vec3(xyz[3 * k], xyz[3 * k + 1], xyz[3 * k + 2]);
+            return;
+        }
+        for (int k = 0; k < 3; k++)
+            v[k] = mesh.positions[mesh.faces[3 * i + k]];
+    }
+
+  private:
+    MappedFile file;
+    Mesh mesh;
+    uint64_t count = 0;
+};
+
+// triangle centroids counted per cell
+struct CountGrid {
+    glm::uvec3 dims{1};
+    glm::vec3 origin{0.0f};
+    float cell_size = 1.0f;
+    std::vector<uint32_t> counts;
+
+    uint64_t cell_index(uint32_t x, uint32_t y, uint32_t z) const {
+        return x + dims.x * (y + (uint64_t)dims.y * z);
+    }
+    uint64_t cell_of(const glm::vec3 &p) const {
+        glm::vec3 c = (p - origin) / cell_size;
+        glm::uvec3 cell;
+        for (int k = 0; k < 3; k++)
+            cell[k] = (uint32_t)glm::clamp(c[k], 0.0f, (float)(dims[k] - 1));
+        return cell_index(cell.x, cell.y, cell.z);
+    }
+};
+
+// half open range of grid cells
+struct CellRange {
+    glm::uvec3 lo, hi;
+};
+
+class ChunkSplitter {
+  public:
+    ChunkSplitter(const CountGrid &_grid, uint64_t _target,
+                  std::vector<ChunkNode> &_nodes)
+        : chunk_of_cell(_grid.counts.size(), NO_CHUNK), grid(_grid),
+          target(_target), nodes(_nodes) {}
+
+    // chunk owning each grid cell, filled as leaves are made
+    std::vector<uint32_t> chunk_of_cell;
+    uint32_t chunk_count = 0;
+
+    // returns the node made for the range, NO_CHUNK when it is empty
+    uint32_t split(CellRange range, uint64_t total) {
+        if (total == 0)
+            return NO_CHUNK;
+        glm::uvec3 extent = range.hi - range.lo;
+        int axis = 0;
+        for (int k = 1; k < 3; k++)
+            if (extent[k] > extent[axis])
+                axis = k;
+        if (total <= target || extent[axis] == 1)
+            return make_leaf(range);
+
+        // triangles per slice of the range along the axis
+        std::vector<uint64_t> slices(extent[axis], 0);
+        for (uint32_t z = range.lo.z; z < range.hi.z; z++)
+            for (uint32_t y = range.lo.y; y < range.hi.y; y++)
+                for (uint32_t x = range.lo.x; x < range.hi.x; x++) {
+                    glm::uvec3 cell(x, y, z);
+                    slices[cell[axis] - range.lo[axis]] +=
+                        grid.counts[grid.cell_index(x, y, z)];
+                }
+        // first slice boundary with at least half of the triangles before it
+        uint32_t mid = 1;
+        uint64_t left_total = slices[0];
+        while (mid + 1 < extent[axis] && 2 * left_total < total)
+            left_total += slices[mid++];
+        uint64_t right_total = total - left_total;
+
+        CellRange left = range, right = range;
+        left.hi[axis] = range.lo[axis] + mid;
+        right.lo[axis] = range.lo[axis] + mid;
+        // an empty side only shrinks the range, no node for it
+        if (left_total == 0)
+            return split(right, right_total);
+        if (right_total == 0)
+            return split(left, left_total);
+
+        // parents come before their children, the root is node 0
+        uint32_t idx = nodes.size();
+        nodes.push_back(ChunkNode{AABB(), NO_CHUNK, {0, 0}});
+        uint32_t l = split(left, left_total);
+        uint32_t r = split(right, right_total);
+        nodes[idx].children[0] = l;
+        nodes[idx].children[1] = r;
+        return idx;
+    }
+
+  private:
+    const CountGrid &grid;
+    uint64_t target;
+    std::vector<ChunkNode> &nodes;
+
+    uint32_t make_leaf(const CellRange &range) {
+        uint32_t chunk = chunk_count++;
+        for (uint32_t z = range.lo.z; z < range.hi.z; z++)
+            for (uint32_t y = range.lo.y; y < range.hi.y; y++)
+                for (uint32_t x = range.lo.x; x < range.hi.x; x++)
+                    chunk_of_cell[grid.cell_index(x, y, z)] = chunk;
+        nodes.push_back(ChunkNode{AABB(), chunk, {0, 0}});
+        return nodes.size() - 1;
+    }
+};
+
+// the temporary binary STL of one chunk, appended to by all workers
+class ChunkWriter {
+  public:
+    ChunkWriter(std::string _filepath) : filepath(std::move(_filepath)) {}
+
+    bool begin() {
+        std::ofstream file(filepath, std::ios::binary | std::ios::trunc);
+        const char header[STL_HEADER_SIZE] = {};
+        file.write(header, sizeof(header));
+        return file.good();
+    }
+
+    // whole records, from any worker
+    void append(const std::vector<char> &records) {
+        if (records.empty())
+            return;
+        std::lock_guard<std::mutex> lock(mutex);
+        // reopened per append, hundreds of chunks would exhaust file handles
+        std::ofstream file(filepath, std::ios::binary | std::ios::app);
+        file.write(records.data(), records.size());
+        ok &= file.good();
+        count += records.size() / STL_RECORD_SIZE;
+    }
+
+    // writes the facet count into the header
+    bool finish() {
+        std::fstream file(filepath,
+                          std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(80);
+        file.write((const char *)&count, sizeof(count));
+        return ok && file.good();
+    }
+
+    const std::string &get_filepath() const { return filepath; }
+
+  private:
+    std::string filepath;
+    std::mutex mutex;
+    uint32_t count = 0;
+    bool ok = true;
+};
+
+void add_record(std::vector<char> &records, const glm::vec3 v[3]) {
+    char record[STL_RECORD_SIZE] = {};
+    // the facet normal stays zero, normals are computed after welding
+    std::memcpy(record + 12, &v[0], sizeof(glm::vec3));
+    std::memcpy(record + 24, &v[1], sizeof(glm::vec3));
+    std::memcpy(record + 36, &v[2], sizeof(glm::vec3));
+    records.insert(records.end(), record, record + STL_RECORD_SIZE);
+}
+
+// removes the files of a build that did not get to the end
+class BuildCleanup {
+  public:
+    BuildCleanup() = default;
+    BuildCleanup(const BuildCleanup &) = delete;
+    BuildCleanup &operator=(const BuildCleanup &) = delete;
+    ~BuildCleanup() {
+        if (done)
+            return;
+        std::error_code ec;
+        for (const std::string &file : files)
+            fs::remove(file, ec);
+    }
+
+    void add(const std::string &file) { files.push_back(file); }
+    void finish() { done = true; }
+
+  private:
+    std::vector<std::string> files;
+    bool done = false;
+};
+
+void grow(AABB &box, const glm::vec3 &p) {
+    box.min = glm::min(box.min, p);
+    box.max = glm::max(box.max, p);
+}
+
+void grow(AABB &box, const AABB &other) {
+    box.min = glm::min(box.min, other.min);
+    box.max = glm::max(box.max, other.max);
+}
+
+} // namespace
+
+bool build_chunks(const std::string &source_path,
+                  const std::string &index_path, const ChunkOptions &opts) {
+    TriangleSource source;
+    if (!source.open(source_path))
+        return false;
+    const uint64_t count = source.size();
+    if (count == 0) {
+        std::cerr << "ERROR::CHUNKS::EMPTY_MESH::" << source_path
+                  << std::endl;
+        return false;
+    }
+
+    // pass 1, bounding box and vertex mean
+    uint32_t workers = num_workers();
+    std::vector<AABB> boxes(workers);
+    std::vector<glm::dvec3> sums(workers, glm::dvec3(0.0));
+    parallel_for(count, 1 << 16, [&](uint64_t begin, uint64_t end,
+                                     uint32_t worker) {
+        for (uint64_t i = begin; i < end; i++) {
+            glm::vec3 v[3];
+            source.get(i, v);
+            for (int k = 0; k < 3; k++) {
+                grow(boxes[worker], v[k]);
+                sums[worker] += glm::dvec3(v[k]);
+            }
+        }
+    });
+    ChunkIndex index;
+    glm::dvec3 sum(0.0);
+    for (uint32_t w = 0; w < workers; w++) {
+        grow(index.bounding_box, boxes[w]);
+        sum += sums[w];
+    }
+
+    // pass 2, centroids per grid cell
+    CountGrid grid;
+    glm::vec3 size = index.bounding_box.max - index.bounding_box.min;
+    grid.origin = index.bounding_box.min;
+    grid.cell_size = glm::max(glm::max(size.x, size.y), size.z) /
+                     (float)opts.grid_resolution;
+    if (grid.cell_size <= 0.0f)
+        grid.cell_size = 1.0f;
+    for (int k = 0; k < 3; k++)
+        grid.dims[k] = glm::clamp((uint32_t)std::ceil(size[k] / grid.cell_size),
+                                  1u, opts.grid_resolution);
+    std::vector<std::atomic<uint32_t>> counts(
+        (uint64_t)grid.dims.x * grid.dims.y * grid.dims.z);
+    parallel_for(count, 1 << 16, [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t i = begin; i < end; i++) {
+            glm::vec3 v[3];
+            source.get(i, v);
+            glm::vec3 centroid = (v[0] + v[1] + v[2]) / 3.0f;
+            counts[grid.cell_of(centroid)].fetch_add(
+                1, std::memory_order_relaxed);
+        }
+    });
+    grid.counts.resize(counts.size());
+    for (size_t i = 0; i < counts.size(); i++)
+        grid.counts[i] = counts[i].load(std::memory_order_relaxed);
+
+    ChunkSplitter splitter(grid, opts.triangles_per_chunk, index.nodes);
+    splitter.split(CellRange{glm::uvec3(0), grid.dims}, count);
+
+    // pass 3, triangles into the temporary file of their chunk; every
+    // worker buffers its own records per chunk
+    BuildCleanup cleanup;
+    std::vector<std::unique_ptr<ChunkWriter>> writers;
+    for (uint32_t c = 0; c < splitter.chunk_count; c++) {
+        fs::path tmp = chunk_filepath(index_path, c);
+        writers.push_back(std::make_unique<ChunkWriter>(
+            tmp.replace_extension(".tmp.stl").string()));
+        cleanup.add(writers.back()->get_filepath());
+        if (!writers.back()->begin()) {
+            std::cerr << "ERROR::CHUNKS::CANNOT_OPEN::"
+                      << writers.back()->get_filepath() << std::endl;
+            return false;
+        }
+    }
+    const size_t worker_buffer =
+        std::max(CHUNK_WRITE_BUFFER / workers, MIN_WORKER_BUFFER);
+    std::vector<std::vector<std::vector<char>>> pending(
+        workers, std::vector<std::vector<char>>(writers.size()));
+    parallel_for(count, 1 << 16, [&](uint64_t begin, uint64_t end,
+                                     uint32_t worker) {
+        std::vector<std::vector<char>> &records = pending[worker];
+        for (uint64_t i = begin; i < end; i++) {
+            glm::vec3 v[3];
+            source.get(i, v);
+            glm::vec3 centroid = (v[0] + v[1] + v[2]) / 3.0f;
+            uint32_t c = splitter.chunk_of_cell[grid.cell_of(centroid)];
+            add_record(records[c], v);
+            if (records[c].size() >= worker_buffer) {
+                writers[c]->append(records[c]);
+                records[c].clear();
+            }
+        }
+    });
+    for (std::vector<std::vector<char>> &records : pending)
+        for (size_t c = 0; c < writers.size(); c++)
+            writers[c]->append(records[c]);
+    pending.clear();
+    for (std::unique_ptr<ChunkWriter> &writer : writers) {
+        if (!writer->finish()) {
+            std::cerr << "ERROR::CHUNKS::CANNOT_WRITE::"
+                      << writer->get_filepath() << std::endl;
+            return false;
+        }
+    }
+
+    // the model matrix of a mesh loaded whole, shared by every chunk
+    Mesh whole;
+    whole.bounding_box = index.bounding_box;
+    whole.center = glm::vec3(sum / (3.0 * (double)count));
+    whole.reset_model_matrix();
+    index.center = whole.center;
+    index.model_matrix = whole.model_matrix;
+
+    // pass 4, one chunk in memory at a time
+    index.chunks.resize(splitter.chunk_count);
+    for (uint32_t c = 0; c < splitter.chunk_count; c++) {
+        const std::string &tmp = writers[c]->get_filepath();
+        std::string out = chunk_filepath(index_path, c);
+        cleanup.add(out);
+        Mesh chunk;
+        // streaming already picks and drops chunks as a whole
+        chunk.with_lods = false;
+        chunk.with_meshlets = false;
+        if (!chunk.load(tmp))
+            return false;
+        BVH bvh(chunk);
+        chunk.model_matrix = index.model_matrix;
+        if (!write_mesher(out, chunk, bvh))
+            return false;
+        std::error_code ec;
+        fs::remove(tmp, ec);
+        index.chunks[c] = ChunkRecord{chunk.bounding_box,
+                                      chunk.triangles.size(),
+                                      (uint64_t)fs::file_size(out, ec)};
+    }
+
+    // children come after their parents, so a reverse sweep sees them first
+    for (size_t i = index.nodes.size(); i-- > 0;) {
+        ChunkNode &node = index.nodes[i];
+        if (node.isleaf()) {
+            node.box = index.chunks[node.chunk].box;
+            continue;
+        }
+        node.box = AABB();
+        grow(node.box, index.nodes[node.children[0]].box);
+        grow(node.box, index.nodes[node.children[1]].box);
+    }
+    if (!index.write(index_path))
+        return false;
+    // the temporary files are gone, the chunks stay
+    cleanup.finish();
+    return true;
+}
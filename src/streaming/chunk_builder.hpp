@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+
+struct ChunkOptions {
+    // target size of a chunk, a single dense grid cell can exceed it
+    uint64_t triangles_per_chunk = 1 << 20;
+    // cells of the counting grid along the longest side of the bounding box
+    uint32_t grid_resolution = 128;
+};
+
+/*
+    Splits the mesh at source_path into spatial chunks without holding it in
+    memory, for scans larger than RAM:
+
+    1. one pass over the triangles for the bounding box, a second one counts
+       the triangle centroids on a coarse grid
+    2. the grid is split like a k-d tree, along the longest side at the
+       median triangle, until a node holds at most triangles_per_chunk;
+       the leaves are the chunks and the tree is kept as the chunk hierarchy
+    3. one more pass appends every triangle to a temporary file of the chunk
+       owning its centroid cell
+    4. chunk by chunk the temporary file is loaded (welded, normals), gets
+       its BVH and is written as a .mesher next to the index
+
+    Binary STL sources are read from the memory map, so only one chunk is
+    ever fully in memory; other formats have no streaming reader and are
+    loaded whole first. Vertices on chunk borders are not welded across
+    chunks, so normals there only average the faces of one chunk.
+*/
+bool build_chunks(const std::string &source_path,
+                  const std::string &index_path,
+                  const ChunkOptions &opts = ChunkOptions());
@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <numeric>
+
+#include "chunked_mesh.hpp"
+#include "../io/mesher_format.hpp"
+
+// uploads per frame, each one copies a whole chunk to the GPU
+constexpr uint32_t MAX_UPLOADS_PER_FRAME = 2;
+
+static float distance_to_box(const glm::vec3 &p, const AABB &box) {
+    glm::vec3 d = glm::max(glm::max(box.min - p, p - box.max), 0.0f);
+    return glm::length(d);
+}
+
+ChunkedMesh::~ChunkedMesh() { close(); }
+
+bool ChunkedMesh::open(const std::string &_index_path) {
+    close();
+    if (!index.read(_index_path) || index.chunks.empty())
+        return false;
+    index_path = _index_path;
+    chunks = std::vector<Chunk>(index.chunks.size());
+    stop = false;
+    worker = std::thread(&ChunkedMesh::run, this);
+    return true;
+}
+
+void ChunkedMesh::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+        queue.clear();
+    }
+    cv.notify_all();
+    if (worker.joinable())
+        worker.join();
+    // drops the GPU buffers too, so this has to run on the render thread
+    chunks.clear();
+    index = ChunkIndex();
+}
+
+void ChunkedMesh::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        cv.wait(lock, [this] { return stop || !queue.empty(); });
+        if (stop)
+            return;
+        uint32_t c = queue.front();
+        queue.pop_front();
+        // dropped from the budget or picked up by pick() meanwhile
+        if (chunks[c].state != ChunkState::Queued)
+            continue;
+        load_chunk(c, lock);
+    }
+}
+
+void ChunkedMesh::load_chunk(uint32_t c, std::unique_lock<std::mutex> &lock) {
+    chunks[c].state = ChunkState::Loading;
+    lock.unlock();
+    auto mesh = std::make_unique<Mesh>();
+    auto bvh = std::make_unique<BVH>();
+    bool ok = read_mesher(chunk_filepath(index_path, c), *mesh, bvh.get());
+    lock.lock();
+    if (ok) {
+        // the BVH points at the heap mesh, which moves along with it
+        chunks[c].mesh = std::move(mesh);
+        chunks[c].bvh = std::move(bvh);
+        chunks[c].state = ChunkState::Loaded;
+    } else {
+        // stays out until the index is opened again
+        chunks[c].state = ChunkState::Failed;
+    }
+    cv.notify_all();
+}
+
+void ChunkedMesh::ensure_loaded(uint32_t c) {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        switch (chunks[c].state) {
+        case ChunkState::Loaded:
+        case ChunkState::Resident:
+        case ChunkState::Failed:
+            return;
+        case ChunkState::Loading:
+            cv.wait(lock);
+            break;
+        case ChunkState::Evicted:
+        case ChunkState::Queued:
+            load_chunk(c, lock);
+            break;
+        }
+    }
+}
+
+void ChunkedMesh::update(const glm::vec3 &eye, uint64_t budget) {
+    if (!is_open())
+        return;
+    std::vector<uint32_t> order(chunks.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::vector<float> dist(chunks.size());
+    for (uint32_t c = 0; c < chunks.size(); c++)
+        dist[c] = distance_to_box(eye, index.chunks[c].box);
+    std::sort(order.begin(), order.end(),
+              [&](uint32_t a, uint32_t b) { return dist[a] < dist[b]; });
+
+    // nearest first until the budget is spent, the nearest chunk always fits
+    std::vector<bool> wanted(chunks.size(), false);
+    uint64_t used = 0;
+    for (uint32_t c : order) {
+        uint64_t size = index.chunks[c].file_size;
+        if (used > 0 && used + size > budget)
+            break;
+        wanted[c] = true;
+        used += size;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    queue.clear();
+    uint32_t uploads = 0;
+    for (uint32_t c : order) {
+        Chunk &chunk = chunks[c];
+        if (!wanted[c]) {
+            if (chunk.state == ChunkState::Loaded ||
+                chunk.state == ChunkState::Resident) {
+                chunk.mesh.reset();
+                chunk.bvh.reset();
+                chunk.state = ChunkState::Evicted;
+            } else if (chunk.state == ChunkState::Queued) {
+                chunk.state = ChunkState::Evicted;
+            }
+            continue;
+        }
+        if (chunk.state == ChunkState::Evicted ||
+            chunk.state == ChunkState::Queued) {
+            chunk.state = ChunkState::Queued;
+            queue.push_back(c);
+        } else if (chunk.state == ChunkState::Loaded &&
+                   uploads < MAX_UPLOADS_PER_FRAME) {
+            chunk.mesh->vertex_format = vertex_format;
+            chunk.mesh->upload();
+            chunk.state = ChunkState::Resident;
+            uploads++;
+        }
+    }
+    if (!queue.empty())
+        cv.notify_all();
+}
+
+void ChunkedMesh::draw(Shader &shader) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (Chunk &chunk : chunks)
+        if (chunk.state == ChunkState::Resident)
+            chunk.mesh->draw(shader);
+}
+
+uint32_t ChunkedMesh::resident_count() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    uint32_t count = 0;
+    for (const Chunk &chunk : chunks)
+        count += chunk.state == ChunkState::Resident;
+    return count;
+}
+
+std::optional<ChunkHit> ChunkedMesh::pick(Ray &ray) {
+    std::optional<ChunkHit> best;
+    if (is_open())
+        pick_internal(ray, 0, best);
+    return best;
+}
+
+void ChunkedMesh::pick_internal(Ray &ray, uint32_t node_idx,
+                                std::optional<ChunkHit> &best) {
+    const ChunkNode &node = index.nodes[node_idx];
+    float t = ray.dist_to_aabb(node.box);
+    if (t == INFINITY || (best && t > best->t))
+        return;
+    if (node.isleaf()) {
+        ensure_loaded(node.chunk);
+        // only the render thread drops chunks, so it stays put until the
+        // next update()
+        BVH *bvh = chunks[node.chunk].bvh.get();
+        if (!bvh)
+            return;
+        auto hit = ray.nearest_hit(*bvh);
+        if (hit && (!best || hit->t < best->t))
+            best = ChunkHit{node.chunk, hit->tri_idx, hit->t};
+        return;
+    }
+    // nearer child first, its hits prune the other one
+    uint32_t first = node.children[0], second = node.children[1];
+    if (ray.dist_to_aabb(index.nodes[second].box) <
+        ray.dist_to_aabb(index.nodes[first].box))
+        std::swap(first, second);
+    pick_internal(ray, first, best);
+    pick_internal(ray, second, best);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../io/chunk_index.hpp"
+#include "../mesh.hpp"
+#include "../raytracer/bvh.hpp"
+
+struct ChunkHit {
+    uint32_t chunk;
+    // index into the chunk mesh's triangles
+    uint32_t tri_idx;
+    float t;
+};
+
+/*
+    A mesh split by build_chunks, kept partly in memory. update() picks the
+    chunks nearest to the camera that fit in the memory budget: missing ones
+    are read on a background thread, the rest are dropped together with
+    their GPU buffers. Loaded chunks are uploaded a few per frame on the
+    render thread so a burst of loads does not stall a frame.
+
+    Picking walks the chunk tree front to back and only descends into
+    chunks the ray can still hit before the best hit so far; a chunk that
+    is not in memory is read on the spot, so picking works everywhere.
+*/
+class ChunkedMesh {
+  public:
+    ChunkedMesh() = default;
+    ~ChunkedMesh();
+
+    ChunkedMesh(const ChunkedMesh &) = delete;
+    ChunkedMesh &operator=(const ChunkedMesh &) = delete;
+
+    bool open(const std::string &index_path);
+    void close();
+    bool is_open() const { return !chunks.empty(); }
+
+    // render thread, once per frame; eye is the camera in model space and
+    // budget the bytes chunks may take in memory
+    void update(const glm::vec3 &eye, uint64_t budget);
+    void draw(Shader &shader);
+    // ray in model space
+    std::optional<ChunkHit> pick(Ray &ray);
+
+    // the chunk has to be in memory, e.g. just returned by pick()
+    Mesh &chunk_mesh(uint32_t chunk) { return *chunks[chunk].mesh; }
+    glm::mat4 get_model_matrix() const { return index.model_matrix; }
+    const ChunkIndex &get_index() const { return index; }
+    uint32_t resident_count() const;
+
+    // picked before open(), applies to every chunk uploaded after it
+    VertexFormat vertex_format = VertexFormat::Float;
+
+  private:
+    enum class ChunkState {
+        Evicted,
+        Queued,
+        Loading,
+        // in memory, waiting for upload()
+        Loaded,
+        Resident,
+        // unreadable file, never queued again
+        Failed,
+    };
+    struct Chunk {
+        ChunkState state = ChunkState::Evicted;
+        std::unique_ptr<Mesh> mesh;
+        std::unique_ptr<BVH> bvh;
+    };
+
+    std::string index_path;
+    ChunkIndex index;
+    std::vector<Chunk> chunks;
+
+    // guards the chunk states and buffers and the queue
+    mutable std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<uint32_t> queue;
+    bool stop = false;
+    std::thread worker;
+
+    void run();
+    // reads chunk c from disk, the lock is released meanwhile
+    void load_chunk(uint32_t c, std::unique_lock<std::mutex> &lock);
+    // blocks until chunk c is in memory
+    void ensure_loaded(uint32_t c);
+    void pick_internal(Ray &ray, uint32_t node_idx,
+                       std::optional<ChunkHit> &best);
+};